@@ -0,0 +1,611 @@
+#include "bench.hpp"
+#include "goxx/goxx.hpp"
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <numeric>
+#include <random>
+#include <shared_mutex>
+#include <unordered_map>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef GOXX_BENCH_STD_PAR
+#include <execution>
+#endif
+
+using namespace std;
+using namespace goxx;
+using goxx::bench::Runner;
+
+// nth producers and nth consumers through one Chan
+void bench_chan(Runner &r) {
+    size_t count = r.options().quick ? 100000 : 1000000;
+    for (size_t nth : {1, 4})
+        for (size_t csize : {0, 1, 16, 1024}) {
+            if (csize == 0 && !r.options().quick && nth == 1)
+                count /= 4;
+            r.run(fmt::format("chan/mpmc/threads={}x{}/size={}", nth, nth,
+                              csize),
+                  count, [&]() {
+                      Chan<int> c{csize};
+                      WaitGroup wg{};
+                      wg.together(
+                          [&](size_t tidx, size_t nthds) {
+                              for (auto i = tidx; i < count; i += nthds) {
+                                  c.push((int)i);
+                              }
+                          },
+                          [&]() { c.close(); }, nth, Launch::dedicated);
+                      wg.together(
+                          [&](size_t, size_t) {
+                              for (auto n : c) {
+                                  (void)n;
+                              }
+                          },
+                          nullptr, nth, Launch::dedicated);
+                      wg.wait();
+                  });
+            if (csize == 0 && !r.options().quick && nth == 1)
+                count *= 4;
+        }
+    for (size_t batch : {16, 256}) {
+        r.run(fmt::format("chan/batch/size=1024/batch={}", batch), count,
+              [&]() {
+                  Chan<int> c{1024};
+                  WaitGroup wg{};
+                  wg.go(
+                      [&]() {
+                          vector<int> buf(batch);
+                          for (size_t i = 0; i < count; i += batch) {
+                              auto n = std::min(batch, count - i);
+                              // push_range may take only part of it
+                              for (auto f = buf.begin(), l = f + n; f != l;) {
+                                  f += c.push_range(f, l);
+                              }
+                          }
+                          c.close();
+                      },
+                      Launch::dedicated);
+                  for (auto &b : c.batches(batch)) {
+                      (void)b;
+                  }
+                  wg.wait();
+              });
+    }
+    for (size_t csize : {1, 64, 1024}) {
+        r.run(fmt::format("chan/spsc/size={}", csize), count * 4, [&]() {
+            SpscChan<int> c{csize};
+            WaitGroup wg{};
+            wg.go(
+                [&]() {
+                    for (size_t i = 0; i < count * 4; i++) {
+                        c.push((int)i);
+                    }
+                    c.close();
+                },
+                Launch::dedicated);
+            for (auto n : c) {
+                (void)n;
+            }
+            wg.wait();
+        });
+    }
+}
+
+// one producer, subscribers on threads of their own, block so that every
+// subscriber reads every value
+void bench_broadcast(Runner &r) {
+    size_t count = r.options().quick ? 100000 : 1000000;
+    for (size_t subs : {1, 8, 32}) {
+        r.run(fmt::format("broadcast/subscribers={}/size=1024", subs), count,
+              [&]() {
+                  BroadcastChan<int> c{1024};
+                  vector<BroadcastChan<int>::Subscription> ss;
+                  for (size_t i = 0; i < subs; i++) {
+                      ss.push_back(c.subscribe());
+                  }
+                  WaitGroup wg{};
+                  for (auto &s : ss) {
+                      wg.go(
+                          [&s]() {
+                              for (const int &n : s) {
+                                  (void)n;
+                              }
+                          },
+                          Launch::dedicated);
+                  }
+                  for (size_t i = 0; i < count; i++) {
+                      c.push((int)i);
+                  }
+                  c.close();
+                  wg.wait();
+              });
+    }
+}
+
+#ifdef __linux__
+// a forked producer process, the consumer in this one
+void bench_shm_chan(Runner &r) {
+    size_t count = r.options().quick ? 100000 : 1000000;
+    auto name = fmt::format("/goxx_bench_{}", getpid());
+    for (size_t csize : {64, 1024}) {
+        r.run(fmt::format("shm_chan/process/size={}", csize), count, [&]() {
+            ShmChan<size_t>::unlink(name);
+            ShmChan<size_t> c{name, csize};
+            auto pid = fork();
+            if (pid == 0) {
+                ShmChan<size_t> p{name, 0};
+                for (size_t i = 0; i < count; i++) {
+                    p.push(i);
+                }
+                p.close();
+                _exit(0);
+            }
+            for (auto n : c) {
+                (void)n;
+            }
+            waitpid(pid, nullptr, 0);
+            ShmChan<size_t>::unlink(name);
+        });
+    }
+}
+#endif
+
+// add and stop with many timers pending, both should stay flat
+void bench_timer(Runner &r) {
+    size_t n = r.options().quick ? 10000 : 100000;
+    for (size_t pending : {0, 100000}) {
+        vector<Timer> keep;
+        for (size_t i = 0; i < pending; i++) {
+            keep.emplace_back(chrono::seconds(60 + i % 3600), []() {});
+        }
+        r.run(fmt::format("timer/add_stop/pending={}", pending), n, [&]() {
+            for (size_t i = 0; i < n; i++) {
+                Timer t{chrono::milliseconds(1 + i % 10000), []() {}};
+                t.stop();
+            }
+        });
+    }
+}
+
+// what a context costs a chan that never waits, and a pop on another
+// thread released by a cancel, thread start included
+void bench_context(Runner &r) {
+    size_t count = r.options().quick ? 100000 : 1000000;
+    auto live = Context{}.with_cancel();
+    for (auto with_ctx : {false, true}) {
+        r.run(fmt::format("context/push_pop/ctx={}", with_ctx), count, [&]() {
+            Chan<size_t> c{64};
+            for (size_t i = 0; i < count; i++) {
+                if (with_ctx) {
+                    c.push(std::move(i), live);
+                    c.pop(live);
+                } else {
+                    c.push(std::move(i));
+                    c.pop();
+                }
+            }
+        });
+    }
+    r.run("context/cancel_wakeup", 1000, [&]() {
+        for (auto i = 0; i < 1000; i++) {
+            Chan<int> c{1};
+            auto ctx = Context{}.with_cancel();
+            WaitGroup wg{};
+            wg.go([&]() { c.pop(ctx); }, Launch::dedicated);
+            ctx.cancel();
+        }
+    });
+}
+
+/*
+    heavy payloads from a producer thread to a consumer, the consumer frees
+    them: new / delete every message, recycled through a MsgPool, or
+    pmr containers on a PoolResource
+ */
+void bench_msg_pool(Runner &r) {
+    size_t count = r.options().quick ? 50000 : 500000;
+    auto pipe = [&](auto &c, auto &&make, auto &&use) {
+        WaitGroup wg{};
+        wg.go(
+            [&]() {
+                for (size_t i = 0; i < count; i++) {
+                    c.push(make(i));
+                }
+                c.close();
+            },
+            Launch::dedicated);
+        size_t sum = 0;
+        for (auto &&m : c) {
+            sum += use(m);
+        }
+        if (sum == 0)
+            fmt::print("no payload\n");
+    };
+    r.run("msg_pool/vector/new", count, [&]() {
+        Chan<vector<int>> c{256};
+        pipe(
+            c, [](size_t i) { return vector<int>(16 + i % 256, (int)i); },
+            [](auto &m) { return m.size(); });
+    });
+    MsgPool<vector<int>> vectors;
+    r.run("msg_pool/vector/pool", count, [&]() {
+        Chan<MsgPool<vector<int>>::Ptr> c{256};
+        pipe(
+            c,
+            [&](size_t i) {
+                auto m = vectors.get();
+                m->assign(16 + i % 256, (int)i);
+                return m;
+            },
+            [](auto &m) { return m->size(); });
+    });
+    PoolResource res;
+    r.run("msg_pool/vector/pmr", count, [&]() {
+        Chan<pmr::vector<int>> c{256};
+        pipe(
+            c,
+            [&](size_t i) {
+                return pmr::vector<int>(16 + i % 256, (int)i, &res);
+            },
+            [](auto &m) { return m.size(); });
+    });
+    auto entries = [](auto &m, size_t i) {
+        for (size_t k = 0; k < 8; k++) {
+            m.emplace(fmt::format("key-{:016}", i + k),
+                      fmt::format("value-{:032}", i));
+        }
+    };
+    r.run("msg_pool/map/new", count, [&]() {
+        Chan<map<string, string>> c{256};
+        pipe(
+            c,
+            [&](size_t i) {
+                map<string, string> m;
+                entries(m, i);
+                return m;
+            },
+            [](auto &m) { return m.size(); });
+    });
+    MsgPool<map<string, string>> maps;
+    r.run("msg_pool/map/pool", count, [&]() {
+        Chan<MsgPool<map<string, string>>::Ptr> c{256};
+        pipe(
+            c,
+            [&](size_t i) {
+                auto m = maps.get();
+                entries(*m, i);
+                return m;
+            },
+            [](auto &m) { return m->size(); });
+    });
+    r.run("msg_pool/map/pmr", count, [&]() {
+        using Map = pmr::map<pmr::string, pmr::string>;
+        Chan<Map> c{256};
+        pipe(
+            c,
+            [&](size_t i) {
+                Map m{&res};
+                entries(m, i);
+                return m;
+            },
+            [](auto &m) { return m.size(); });
+    });
+}
+
+/*
+    bytes through a ByteChan in 64KB chunks, against one memcpy of them.
+    the chan costs a second copy and the hand over, Chan<vector<char>>
+    allocates a chunk on top. file copies go through the page cache, ops
+    are bytes
+ */
+void bench_byte_chan(Runner &r) {
+    size_t total = r.options().quick ? (32 << 20) : (256 << 20);
+    size_t chunk = 64 << 10;
+    vector<char> src(total, 'x'), dst(total);
+    r.run("byte_chan/memcpy", total, [&]() {
+        for (size_t pos = 0; pos < total; pos += chunk) {
+            memcpy(dst.data() + pos, src.data() + pos, chunk);
+        }
+    });
+    r.run("byte_chan/chan_vector", total, [&]() {
+        Chan<vector<char>> c{16};
+        WaitGroup wg{};
+        wg.go(
+            [&]() {
+                for (size_t pos = 0; pos < total; pos += chunk) {
+                    c.push(vector<char>(src.data() + pos,
+                                        src.data() + pos + chunk));
+                }
+                c.close();
+            },
+            Launch::dedicated);
+        size_t pos = 0;
+        for (auto &&v : c) {
+            memcpy(dst.data() + pos, v.data(), v.size());
+            pos += v.size();
+        }
+    });
+    r.run("byte_chan/byte_chan", total, [&]() {
+        ByteChan c{16 * chunk};
+        WaitGroup wg{};
+        wg.go(
+            [&]() {
+                for (size_t pos = 0; pos < total; pos += chunk) {
+                    auto buf = c.prepare(chunk);
+                    memcpy(buf.data(), src.data() + pos, chunk);
+                    c.commit(chunk);
+                }
+                c.close();
+            },
+            Launch::dedicated);
+        size_t pos = 0;
+        for (auto v = c.read_view(); !v.empty(); v = c.read_view()) {
+            memcpy(dst.data() + pos, v.data(), v.size());
+            c.consume(v.size());
+            pos += v.size();
+        }
+    });
+#ifdef __linux__
+    auto in = fmt::format("/tmp/goxx_bench_in_{}", getpid());
+    auto out = fmt::format("/tmp/goxx_bench_out_{}", getpid());
+    {
+        auto fd = ::open(in.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        for (size_t pos = 0; fd >= 0 && pos < total; pos += chunk) {
+            if (::write(fd, src.data() + pos, chunk) != (ssize_t)chunk)
+                break;
+        }
+        ::close(fd);
+    }
+    auto copy = [&](auto &&body) {
+        return [&, body]() {
+            auto from = ::open(in.c_str(), O_RDONLY);
+            auto to = ::open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (body(from, to) != total)
+                fmt::print("short copy\n");
+            ::close(from);
+            ::close(to);
+        };
+    };
+    r.run("byte_chan/file_copy/read_write", total, copy([&](int from, int to) {
+              size_t done = 0;
+              for (ssize_t n; (n = ::read(from, dst.data(), chunk)) > 0;) {
+                  done += ::write(to, dst.data(), n);
+              }
+              return done;
+          }));
+    r.run("byte_chan/file_copy/byte_chan", total, copy([&](int from, int to) {
+              ByteChan c{16 * chunk};
+              WaitGroup wg{};
+              wg.go(
+                  [&]() {
+                      for (;;) {
+                          auto buf = c.prepare(chunk);
+                          auto n = ::read(from, buf.data(), buf.size());
+                          if (n <= 0)
+                              break;
+                          c.commit(n);
+                      }
+                      c.close();
+                  },
+                  Launch::dedicated);
+              size_t done = 0;
+              for (auto v = c.read_view(); !v.empty(); v = c.read_view()) {
+                  auto n = ::write(to, v.data(), v.size());
+                  if (n <= 0) {
+                      c.close(); // lets the producer go
+                      break;
+                  }
+                  c.consume(n);
+                  done += n;
+              }
+              return done;
+          }));
+    ::unlink(in.c_str());
+    ::unlink(out.c_str());
+#endif
+}
+
+void bench_wait_group(Runner &r) {
+    size_t count = r.options().quick ? 10000 : 100000;
+    for (auto launch : {Launch::pool, Launch::dedicated}) {
+        auto name = launch == Launch::pool ? "pool" : "dedicated";
+        auto n = launch == Launch::pool ? count : count / 10;
+        r.run(fmt::format("wait_group/spawn/{}", name), n, [&]() {
+            atomic<size_t> sum{0};
+            WaitGroup wg{};
+            for (size_t i = 0; i < n; i++) {
+                wg.go([&sum, i]() { sum += i; }, launch);
+            }
+        });
+        // latency of one spawn and join
+        r.run(fmt::format("wait_group/round_trip/{}", name), 1000, [&]() {
+            for (auto i = 0; i < 1000; i++) {
+                WaitGroup wg{};
+                wg.go([]() {}, launch);
+            }
+        });
+    }
+}
+
+void bench_sort(Runner &r) {
+    vector<size_t> sizes{100000, 1000000};
+    if (!r.options().quick)
+        sizes.push_back(10000000);
+    for (auto n : sizes)
+        for (string input : {"random", "sorted", "reversed", "few_unique"}) {
+            vector<size_t> orig(n);
+            mt19937_64 rng{n};
+            for (size_t i = 0; i < n; i++) {
+                orig[i] = input == "random"     ? rng()
+                          : input == "sorted"   ? i
+                          : input == "reversed" ? n - i
+                                                : rng() % 16;
+            }
+            vector<size_t> vec;
+            auto setup = [&]() { vec = orig; };
+            r.run(fmt::format("sort/std::sort/{}/n={}", input, n), n,
+                  [&]() { std::sort(vec.begin(), vec.end()); }, setup);
+            r.run(fmt::format("sort/mt_sort/{}/n={}", input, n), n,
+                  [&]() { mt_sort(vec.begin(), vec.end()); }, setup);
+            // a lambda comparator keeps mt_sort on the comparison path
+            r.run(fmt::format("sort/mt_sort_cmp/{}/n={}", input, n), n,
+                  [&]() {
+                      mt_sort(vec.begin(), vec.end(),
+                              [](size_t a, size_t b) { return a < b; });
+                  },
+                  setup);
+        }
+}
+
+// memory light kernels against the serial std algorithms and, when built
+// with a parallel STL backend, std::execution::par
+void bench_parallel(Runner &r) {
+    size_t n = r.options().quick ? 1000000 : 20000000;
+    vector<double> in(n), out(n);
+    iota(in.begin(), in.end(), 0.0);
+    // a few flops per element, so memory bandwidth is not all that counts
+    auto kernel = [](double x) {
+        for (auto i = 0; i < 8; i++) {
+            x = x * 0.999 + 1.0 / (x + 1.0);
+        }
+        return x;
+    };
+    r.run("parallel/transform/std", n, [&]() {
+        std::transform(in.begin(), in.end(), out.begin(), kernel);
+    });
+    r.run("parallel/transform/goxx", n, [&]() {
+        parallel_transform(in.begin(), in.end(), out.begin(), kernel);
+    });
+    r.run("parallel/for/goxx", n, [&]() {
+        parallel_for(out.begin(), out.end(),
+                     [&](double &x) { x = kernel(x); });
+    });
+    r.run("parallel/reduce/std", n, [&]() {
+        if (std::reduce(in.begin(), in.end(), 0.0) < 0)
+            fmt::print("negative sum\n");
+    });
+    r.run("parallel/reduce/goxx", n, [&]() {
+        if (parallel_reduce(in.begin(), in.end(), 0.0) < 0)
+            fmt::print("negative sum\n");
+    });
+    r.run("parallel/inclusive_scan/std", n, [&]() {
+        std::inclusive_scan(in.begin(), in.end(), out.begin());
+    });
+    r.run("parallel/inclusive_scan/goxx", n, [&]() {
+        parallel_inclusive_scan(in.begin(), in.end(), out.begin());
+    });
+#ifdef GOXX_BENCH_STD_PAR
+    auto par = std::execution::par;
+    r.run("parallel/transform/std::par", n, [&]() {
+        std::transform(par, in.begin(), in.end(), out.begin(), kernel);
+    });
+    r.run("parallel/for/std::par", n, [&]() {
+        std::for_each(par, out.begin(), out.end(),
+                      [&](double &x) { x = kernel(x); });
+    });
+    r.run("parallel/reduce/std::par", n, [&]() {
+        if (std::reduce(par, in.begin(), in.end(), 0.0) < 0)
+            fmt::print("negative sum\n");
+    });
+    r.run("parallel/inclusive_scan/std::par", n, [&]() {
+        std::inclusive_scan(par, in.begin(), in.end(), out.begin());
+    });
+#endif
+}
+
+// three cheap stages, fused into one vs a chan hop in front of each
+void bench_pipeline(Runner &r) {
+    using namespace goxx::pipeline;
+    size_t n = r.options().quick ? 100000 : 1000000;
+    vector<int> in(n);
+    iota(in.begin(), in.end(), 0);
+    auto inc = [](int x) { return x + 1; };
+    auto odd = [](int x) { return x % 2 == 1; };
+    r.run("pipeline/fused", n, [&]() {
+        long long sum = 0;
+        from(in.begin(), in.end()) | goxx::pipeline::map(inc) | filter(odd) |
+            goxx::pipeline::map(inc) | sink([&](int x) { sum += x; });
+    });
+    r.run("pipeline/hops", n, [&]() {
+        long long sum = 0;
+        from(in.begin(), in.end()) | goxx::pipeline::map(inc, 1) |
+            filter(odd) | goxx::pipeline::map(inc, 1) |
+            sink([&](int x) { sum += x; });
+    });
+    r.run("pipeline/ordered/4", n, [&]() {
+        long long sum = 0;
+        from(in.begin(), in.end()) | goxx::pipeline::map(inc, 4, true) |
+            sink([&](int x) { sum += x; });
+    });
+}
+
+// readers hammering one tag: a shared_mutex registry like get() used to be,
+// goxx::get and a resolved Handle
+void bench_get(Runner &r) {
+    struct Legacy {
+        shared_mutex mtx;
+        unordered_map<string, weak_ptr<int>> refs;
+        shared_ptr<int> get(const string &tag) {
+            auto sl = shared_lock{mtx};
+            if (auto itr = refs.find(tag); itr != refs.end()) {
+                return itr->second.lock();
+            }
+            return nullptr;
+        }
+    };
+    auto keep = goxx::get<int>([]() { return new int{42}; }, {"bench"});
+    Legacy legacy;
+    legacy.refs["bench"] = keep;
+    auto h = goxx::handle<int>({"bench"});
+    size_t count = r.options().quick ? 20000 : 200000;
+    for (size_t nth : {1, 4, 16, 64}) {
+        auto readers = [&](auto read) {
+            return [&, read]() {
+                WaitGroup wg{};
+                for (size_t t = 0; t < nth; t++) {
+                    wg.go(
+                        [&]() {
+                            for (size_t i = 0; i < count; i++) {
+                                if (*read() != 42) {
+                                    fmt::print("wrong value\n");
+                                }
+                            }
+                        },
+                        Launch::dedicated);
+                }
+            };
+        };
+        r.run(fmt::format("get/shared_mutex/readers={}", nth), count * nth,
+              readers([&]() { return legacy.get("bench"); }));
+        r.run(fmt::format("get/get/readers={}", nth), count * nth,
+              readers([]() { return goxx::get<int>({"bench"}); }));
+        r.run(fmt::format("get/handle/readers={}", nth), count * nth,
+              readers([&]() { return h.get(); }));
+    }
+}
+
+int main(int argc, char **argv) {
+    Runner r{goxx::bench::parse_options(argc, argv)};
+    bench_chan(r);
+    bench_broadcast(r);
+#ifdef __linux__
+    bench_shm_chan(r);
+#endif
+    bench_wait_group(r);
+    bench_timer(r);
+    bench_context(r);
+    bench_msg_pool(r);
+    bench_byte_chan(r);
+    bench_sort(r);
+    bench_parallel(r);
+    bench_pipeline(r);
+    bench_get(r);
+    r.finish();
+    return 0;
+}
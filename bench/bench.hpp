@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fmt/core.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+namespace goxx {
+namespace bench {
+
+/*
+    tiny benchmark harness
+
+    a benchmark is a body doing `ops` operations. it is run `warmup` times
+    untimed, then `reps` times timed, an optional setup runs untimed before
+    every run. reported per benchmark: seconds per rep (min, percentiles,
+    max), ops / sec and ns / op at the median, context switches per op and
+    the resident set size once the last rep is over
+ */
+struct Options {
+    size_t warmup = 1;
+    size_t reps = 7;
+    bool quick = false;  // smaller sizes, for a fast sanity run
+    std::string filter;  // only names containing it
+    std::string json;    // write results there too
+    std::string label;   // free form, e.g. the commit
+};
+
+struct Result {
+    std::string name;
+    size_t ops = 0;
+    std::vector<double> seconds; // one per timed rep, sorted
+    double csw_per_op = 0;
+    double rss_mb = 0;
+
+    double percentile(double p) const;
+    double median() const { return percentile(50); }
+    double ops_per_sec() const { return ops / median(); }
+    double ns_per_op() const { return median() * 1e9 / ops; }
+};
+
+class Runner {
+  public:
+    explicit Runner(Options options);
+
+    void run(const std::string &name, size_t ops,
+             const std::function<void()> &body,
+             const std::function<void()> &setup = nullptr);
+
+    const Options &options() const { return options_; }
+
+    // writes options().json if set
+    void finish() const;
+
+  private:
+    Options options_;
+    std::vector<Result> results_;
+};
+
+// resident set size in MB, 0 where /proc is missing
+double resident_mb();
+
+// command line: --reps n --warmup n --filter s --json file --label s --quick
+Options parse_options(int argc, char **argv);
+
+} // namespace bench
+} // namespace goxx
+
+#include "bench.ipp"
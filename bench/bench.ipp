@@ -0,0 +1,142 @@
+#pragma once
+#include "bench.hpp"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace goxx {
+namespace bench {
+
+inline double Result::percentile(double p) const {
+    if (seconds.empty())
+        return 0;
+    // nearest rank
+    auto rank = (size_t)std::ceil(p / 100 * seconds.size());
+    return seconds[std::min(seconds.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+inline Runner::Runner(Options options) : options_{std::move(options)} {
+    fmt::print("{:<44} {:>10} {:>10} {:>10} {:>14} {:>10} {:>9} {:>8}\n",
+               "name", "min ms", "p50 ms", "p90 ms", "ops/s", "ns/op",
+               "csw/op", "rss MB");
+}
+
+inline void Runner::run(const std::string &name, size_t ops,
+                        const std::function<void()> &body,
+                        const std::function<void()> &setup) {
+    if (!options_.filter.empty() &&
+        name.find(options_.filter) == std::string::npos)
+        return;
+    for (size_t i = 0; i < options_.warmup; i++) {
+        if (setup)
+            setup();
+        body();
+    }
+    Result res;
+    res.name = name;
+    res.ops = ops;
+    long csw = 0;
+    for (size_t i = 0; i < options_.reps; i++) {
+        if (setup)
+            setup();
+        rusage before{}, after{};
+        getrusage(RUSAGE_SELF, &before);
+        auto t = std::chrono::steady_clock::now();
+        body();
+        auto d = std::chrono::steady_clock::now() - t;
+        getrusage(RUSAGE_SELF, &after);
+        res.seconds.push_back(std::chrono::duration<double>(d).count());
+        csw += (after.ru_nvcsw - before.ru_nvcsw) +
+               (after.ru_nivcsw - before.ru_nivcsw);
+    }
+    std::sort(res.seconds.begin(), res.seconds.end());
+    res.csw_per_op = (double)csw / options_.reps / ops;
+    res.rss_mb = resident_mb();
+    fmt::print("{:<44} {:>10.3f} {:>10.3f} {:>10.3f} {:>14.0f} {:>10.1f} "
+               "{:>9.3f} {:>8.1f}\n",
+               name, res.seconds.front() * 1e3, res.median() * 1e3,
+               res.percentile(90) * 1e3, res.ops_per_sec(), res.ns_per_op(),
+               res.csw_per_op, res.rss_mb);
+    std::fflush(stdout);
+    results_.push_back(std::move(res));
+}
+
+inline void Runner::finish() const {
+    if (options_.json.empty())
+        return;
+    auto f = std::fopen(options_.json.c_str(), "w");
+    if (!f)
+        throw std::runtime_error("can not open " + options_.json);
+    // names and labels are plain ascii, only quotes need escaping
+    auto quote = [](std::string s) {
+        std::string out = "\"";
+        for (auto c : s) {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out + "\"";
+    };
+    fmt::print(f, "{{\n  \"label\": {},\n  \"reps\": {},\n  \"warmup\": {},\n",
+               quote(options_.label), options_.reps, options_.warmup);
+    fmt::print(f, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results_.size(); i++) {
+        auto &r = results_[i];
+        fmt::print(f,
+                   "    {{\"name\": {}, \"ops\": {}, \"seconds\": {{\"min\": "
+                   "{:.9f}, \"p50\": {:.9f}, \"p90\": {:.9f}, \"p99\": "
+                   "{:.9f}, \"max\": {:.9f}}}, \"ops_per_sec\": {:.3f}, "
+                   "\"ns_per_op\": {:.3f}, \"csw_per_op\": {:.6f}, "
+                   "\"rss_mb\": {:.1f}}}{}\n",
+                   quote(r.name), r.ops, r.seconds.front(), r.percentile(50),
+                   r.percentile(90), r.percentile(99), r.seconds.back(),
+                   r.ops_per_sec(), r.ns_per_op(), r.csw_per_op, r.rss_mb,
+                   i + 1 < results_.size() ? "," : "");
+    }
+    fmt::print(f, "  ]\n}}\n");
+    std::fclose(f);
+}
+
+inline double resident_mb() {
+    auto f = std::fopen("/proc/self/statm", "r");
+    if (!f)
+        return 0;
+    long size = 0, resident = 0;
+    auto n = std::fscanf(f, "%ld %ld", &size, &resident);
+    std::fclose(f);
+    if (n != 2)
+        return 0;
+    return (double)resident * sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+inline Options parse_options(int argc, char **argv) {
+    Options o;
+    for (int i = 1; i < argc; i++) {
+        auto arg = std::string{argv[i]};
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::invalid_argument(arg + " needs a value");
+            return argv[++i];
+        };
+        if (arg == "--reps") {
+            o.reps = std::max<size_t>(1, std::stoul(value()));
+        } else if (arg == "--warmup") {
+            o.warmup = std::stoul(value());
+        } else if (arg == "--filter") {
+            o.filter = value();
+        } else if (arg == "--json") {
+            o.json = value();
+        } else if (arg == "--label") {
+            o.label = value();
+        } else if (arg == "--quick") {
+            o.quick = true;
+        } else {
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+    return o;
+}
+
+} // namespace bench
+} // namespace goxx
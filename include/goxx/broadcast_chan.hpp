@@ -0,0 +1,145 @@
+#pragma once
+
+#include "goxx/executor.hpp"
+#include "goxx/padded.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace goxx {
+
+// what a push does when the ring is full because of a subscriber
+enum class Overflow {
+    block,       // wait for the slowest subscriber
+    drop_oldest, // the subscriber skips to the oldest value still in the ring
+    disconnect,  // the subscriber is cut off, it sees the end of the stream
+};
+
+/*
+    broadcast chan, every subscriber sees every value pushed after it
+    subscribed
+
+    one ring shared by all subscribers, each subscriber only owns a cursor
+    on its own cache line. values are read in place by const reference,
+    the slot under a subscriber's cursor is pinned while it reads: neither
+    overwritten nor dropped, so keep a read short or copy the value.
+
+    pushes are serialized, the producer only looks at the cursors when it
+    is about to overwrite a slot that the slowest cursor it knew of may not
+    have passed yet.
+
+        BroadcastChan<Quote> quotes{4096, Overflow::drop_oldest};
+        auto sub = quotes.subscribe();
+        for (const Quote &q : sub) { }
+
+    a subscription must not outlive its chan.
+ */
+template <class T>
+class BroadcastChan {
+    struct Cursor;
+
+  public:
+    BroadcastChan(size_t size, Overflow overflow = Overflow::block);
+    ~BroadcastChan(); // calls close
+
+    void close();
+    bool closed();
+
+    bool push(T &&t);
+    bool try_push(T &&t); // false instead of waiting for a subscriber
+
+    class Subscription {
+        friend class BroadcastChan;
+
+      public:
+        Subscription(Subscription &&other);
+        Subscription &operator=(Subscription &&other);
+        ~Subscription(); // unsubscribes
+
+        // f(const T &) on the next value, false once closed and drained or
+        // disconnected
+        template <class F>
+        bool next(F &&f);
+        std::optional<T> pop(); // a copy
+        std::optional<T> try_pop();
+
+        size_t dropped() const; // values skipped by Overflow::drop_oldest
+        bool disconnected() const;
+
+        /***************************************
+             range expression, the value stays pinned for the body
+              for (const T &x : sub) { }
+         ********************************/
+        class Iterator {
+            friend class Subscription;
+
+          public:
+            Iterator(Iterator &&other);
+            ~Iterator();
+            bool operator!=(const Iterator &end) const;
+            void operator++();
+            const T &operator*() const;
+
+          private:
+            explicit Iterator(Subscription *s);
+            Subscription *s_;
+            size_t pos_ = 0;
+            bool pinned_ = false;
+        };
+        Iterator begin();
+        Iterator end();
+
+      private:
+        Subscription(BroadcastChan *c, Cursor *cursor);
+        void unsubscribe();
+        BroadcastChan *c_;
+        Cursor *cursor_;
+    };
+
+    // starts at the next value pushed
+    Subscription subscribe();
+
+  private:
+    // top bit of a cursor: the subscriber is reading the slot
+    static constexpr size_t pinned_bit = ~(~size_t{0} >> 1);
+    static constexpr size_t disconnected = pinned_bit >> 1;
+
+    struct alignas(cache_line_size) Cursor {
+        std::atomic<size_t> pos;
+        std::atomic<size_t> dropped{0};
+    };
+
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        T *value();
+    };
+
+    bool put(T &t, bool wait);
+    // pin the next value, false once there is none to come
+    bool pin(Cursor &cur, size_t &pos, bool wait);
+    void unpin(Cursor &cur, size_t pos);
+    // true once no cursor holds the value the slot of pos has
+    bool make_room(size_t pos, bool wait);
+    bool scan(size_t pos); // mtx_ held
+
+    const size_t size_;
+    const Overflow overflow_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(cache_line_size) std::atomic<size_t> tail_{0};
+    size_t oldest_cursor_ = 0; // producer only, no cursor is below it
+    std::mutex push_mtx_;
+    alignas(cache_line_size) std::atomic<size_t> readers_parked_{0};
+    std::atomic<size_t> producers_parked_{0};
+    std::atomic<bool> closed_{false};
+    std::mutex mtx_; // cursors_, parking
+    std::condition_variable readable_;
+    std::condition_variable writable_;
+    std::vector<Cursor *> cursors_;
+};
+
+} // namespace goxx
+
+#include "goxx/broadcast_chan.ipp"
@@ -0,0 +1,322 @@
+#pragma once
+
+#include "goxx/broadcast_chan.hpp"
+#include "goxx/defer.hpp"
+#include <algorithm>
+#include <new>
+#include <utility>
+
+namespace goxx {
+
+template <class T>
+BroadcastChan<T>::BroadcastChan(size_t size, Overflow overflow)
+    : size_(size ? size : 1), overflow_(overflow), slots_(new Slot[size_]) {}
+
+template <class T>
+BroadcastChan<T>::~BroadcastChan() {
+    close();
+    auto tail = tail_.load(std::memory_order_acquire);
+    for (auto pos = tail > size_ ? tail - size_ : 0; pos != tail; pos++) {
+        slots_[pos % size_].value()->~T();
+    }
+}
+
+template <class T>
+T *BroadcastChan<T>::Slot::value() {
+    return std::launder(reinterpret_cast<T *>(storage));
+}
+
+template <class T>
+void BroadcastChan<T>::close() {
+    closed_.store(true, std::memory_order_seq_cst);
+    auto lg = std::lock_guard{mtx_};
+    readable_.notify_all();
+    writable_.notify_all();
+}
+
+template <class T>
+bool BroadcastChan<T>::closed() {
+    return closed_.load(std::memory_order_acquire);
+}
+
+template <class T>
+bool BroadcastChan<T>::push(T &&t) {
+    return put(t, true);
+}
+
+template <class T>
+bool BroadcastChan<T>::try_push(T &&t) {
+    return put(t, false);
+}
+
+template <class T>
+bool BroadcastChan<T>::put(T &t, bool wait) {
+    auto lg = std::lock_guard{push_mtx_};
+    if (closed())
+        return false;
+    auto pos = tail_.load(std::memory_order_relaxed);
+    if (!make_room(pos, wait))
+        return false;
+    auto &slot = slots_[pos % size_];
+    if (pos >= size_)
+        slot.value()->~T();
+    new (slot.storage) T(std::move(t));
+    tail_.store(pos + 1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (readers_parked_.load(std::memory_order_relaxed) > 0) {
+        auto lg = std::lock_guard{mtx_};
+        readable_.notify_all();
+    }
+    return true;
+}
+
+/*
+    the value in the slot of pos is pos - size_. cursors only move forward
+    and a new one starts at tail_, so oldest_cursor_ stays a lower bound of
+    them all and the cursors are only scanned once it catches up
+ */
+template <class T>
+bool BroadcastChan<T>::make_room(size_t pos, bool wait) {
+    if (pos < size_ || oldest_cursor_ > pos - size_)
+        return true;
+    {
+        auto lg = std::lock_guard{mtx_};
+        if (scan(pos))
+            return true;
+    }
+    if (!wait)
+        return false;
+    // parked is raised before the cursors are scanned again, unpin reads it
+    // after moving a cursor
+    Executor::Blocking blocking;
+    auto ul = std::unique_lock{mtx_};
+    producers_parked_.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto room = false;
+    writable_.wait(ul, [&]() { return closed() || (room = scan(pos)); });
+    producers_parked_.fetch_sub(1, std::memory_order_relaxed);
+    return room;
+}
+
+/*
+    a cursor at or below pos - size_ lags: Overflow::block waits for it, the
+    others move it with a cas, which fails while its subscriber has the
+    value pinned, then it is waited for like with block
+ */
+template <class T>
+bool BroadcastChan<T>::scan(size_t pos) {
+    auto old = pos - size_;
+    auto lowest = pos;
+    auto room = true;
+    auto cut = false;
+    for (auto *cur : cursors_) {
+        auto p = cur->pos.load(std::memory_order_acquire);
+        while (p != disconnected) {
+            auto at = p & ~pinned_bit;
+            if (at > old) {
+                lowest = std::min(lowest, at);
+                break;
+            }
+            if (overflow_ == Overflow::block || (p & pinned_bit)) {
+                room = false;
+                break;
+            }
+            auto to =
+                overflow_ == Overflow::drop_oldest ? old + 1 : disconnected;
+            if (cur->pos.compare_exchange_weak(p, to,
+                                               std::memory_order_acq_rel,
+                                               std::memory_order_acquire)) {
+                if (to == disconnected) {
+                    cut = true;
+                } else {
+                    cur->dropped.fetch_add(to - at, std::memory_order_relaxed);
+                    lowest = std::min(lowest, to);
+                }
+                break;
+            }
+        }
+    }
+    if (cut)
+        readable_.notify_all();
+    if (room)
+        oldest_cursor_ = lowest;
+    return room;
+}
+
+template <class T>
+bool BroadcastChan<T>::pin(Cursor &cur, size_t &pos, bool wait) {
+    for (;;) {
+        auto p = cur.pos.load(std::memory_order_acquire);
+        if (p == disconnected)
+            return false;
+        if (p < tail_.load(std::memory_order_acquire)) {
+            // fails if the producer moved the cursor first
+            if (cur.pos.compare_exchange_weak(p, p | pinned_bit,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                pos = p;
+                return true;
+            }
+            continue;
+        }
+        if (closed()) {
+            if (p < tail_.load(std::memory_order_acquire))
+                continue;
+            return false;
+        }
+        if (!wait)
+            return false;
+        Executor::Blocking blocking;
+        auto ul = std::unique_lock{mtx_};
+        readers_parked_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        readable_.wait(ul, [&]() {
+            return closed() || cur.pos.load(std::memory_order_acquire) != p ||
+                   tail_.load(std::memory_order_acquire) > p;
+        });
+        readers_parked_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+template <class T>
+void BroadcastChan<T>::unpin(Cursor &cur, size_t pos) {
+    cur.pos.store(pos + 1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (producers_parked_.load(std::memory_order_relaxed) > 0) {
+        auto lg = std::lock_guard{mtx_};
+        writable_.notify_all();
+    }
+}
+
+template <class T>
+typename BroadcastChan<T>::Subscription BroadcastChan<T>::subscribe() {
+    auto lg = std::lock_guard{mtx_};
+    auto *cur = new Cursor{};
+    cur->pos.store(tail_.load(std::memory_order_acquire),
+                   std::memory_order_relaxed);
+    cursors_.push_back(cur);
+    return Subscription{this, cur};
+}
+
+template <class T>
+BroadcastChan<T>::Subscription::Subscription(BroadcastChan *c, Cursor *cursor)
+    : c_(c), cursor_(cursor) {}
+
+template <class T>
+BroadcastChan<T>::Subscription::Subscription(Subscription &&other)
+    : c_(other.c_), cursor_(std::exchange(other.cursor_, nullptr)) {}
+
+template <class T>
+typename BroadcastChan<T>::Subscription &
+BroadcastChan<T>::Subscription::operator=(Subscription &&other) {
+    if (this != &other) {
+        unsubscribe();
+        c_ = other.c_;
+        cursor_ = std::exchange(other.cursor_, nullptr);
+    }
+    return *this;
+}
+
+template <class T>
+BroadcastChan<T>::Subscription::~Subscription() {
+    unsubscribe();
+}
+
+// a producer waiting on this cursor scans again without it
+template <class T>
+void BroadcastChan<T>::Subscription::unsubscribe() {
+    if (!cursor_)
+        return;
+    auto lg = std::lock_guard{c_->mtx_};
+    auto &cursors = c_->cursors_;
+    cursors.erase(std::find(cursors.begin(), cursors.end(), cursor_));
+    delete std::exchange(cursor_, nullptr);
+    c_->writable_.notify_all();
+}
+
+template <class T>
+template <class F>
+bool BroadcastChan<T>::Subscription::next(F &&f) {
+    size_t pos;
+    if (!c_->pin(*cursor_, pos, true))
+        return false;
+    goxx_defer([&]() { c_->unpin(*cursor_, pos); });
+    f(std::as_const(*c_->slots_[pos % c_->size_].value()));
+    return true;
+}
+
+template <class T>
+std::optional<T> BroadcastChan<T>::Subscription::pop() {
+    std::optional<T> res;
+    next([&](const T &t) { res.emplace(t); });
+    return res;
+}
+
+template <class T>
+std::optional<T> BroadcastChan<T>::Subscription::try_pop() {
+    size_t pos;
+    if (!c_->pin(*cursor_, pos, false))
+        return std::nullopt;
+    goxx_defer([&]() { c_->unpin(*cursor_, pos); });
+    return *c_->slots_[pos % c_->size_].value();
+}
+
+template <class T>
+size_t BroadcastChan<T>::Subscription::dropped() const {
+    return cursor_->dropped.load(std::memory_order_relaxed);
+}
+
+template <class T>
+bool BroadcastChan<T>::Subscription::disconnected() const {
+    return cursor_->pos.load(std::memory_order_acquire) ==
+           BroadcastChan::disconnected;
+}
+
+template <class T>
+typename BroadcastChan<T>::Subscription::Iterator
+BroadcastChan<T>::Subscription::begin() {
+    return Iterator{this};
+}
+
+template <class T>
+typename BroadcastChan<T>::Subscription::Iterator
+BroadcastChan<T>::Subscription::end() {
+    return Iterator{nullptr};
+}
+
+template <class T>
+BroadcastChan<T>::Subscription::Iterator::Iterator(Subscription *s) : s_(s) {
+    if (s_)
+        pinned_ = s_->c_->pin(*s_->cursor_, pos_, true);
+}
+
+template <class T>
+BroadcastChan<T>::Subscription::Iterator::Iterator(Iterator &&other)
+    : s_(other.s_), pos_(other.pos_),
+      pinned_(std::exchange(other.pinned_, false)) {}
+
+// leaving the loop early consumes the pinned value
+template <class T>
+BroadcastChan<T>::Subscription::Iterator::~Iterator() {
+    if (pinned_)
+        s_->c_->unpin(*s_->cursor_, pos_);
+}
+
+template <class T>
+bool BroadcastChan<T>::Subscription::Iterator::operator!=(
+    const Iterator &) const {
+    return pinned_;
+}
+
+template <class T>
+void BroadcastChan<T>::Subscription::Iterator::operator++() {
+    s_->c_->unpin(*s_->cursor_, pos_);
+    pinned_ = s_->c_->pin(*s_->cursor_, pos_, true);
+}
+
+template <class T>
+const T &BroadcastChan<T>::Subscription::Iterator::operator*() const {
+    return *s_->c_->slots_[pos_ % s_->c_->size_].value();
+}
+
+} // namespace goxx
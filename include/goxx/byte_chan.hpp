@@ -0,0 +1,123 @@
+#pragma once
+
+#include "goxx/padded.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+namespace goxx {
+
+#if __cplusplus >= 202002L
+using ByteSpan = std::span<char>;
+#else
+// the part of std::span<char> ByteChan needs, until C++20
+class ByteSpan {
+  public:
+    ByteSpan() = default;
+    ByteSpan(char *data, size_t size) : data_(data), size_(size) {}
+
+    char *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    char &operator[](size_t i) const { return data_[i]; }
+    char *begin() const { return data_; }
+    char *end() const { return data_ + size_; }
+    ByteSpan first(size_t n) const { return {data_, n}; }
+    ByteSpan subspan(size_t off) const { return {data_ + off, size_ - off}; }
+
+  private:
+    char *data_ = nullptr;
+    size_t size_ = 0;
+};
+#endif
+
+/*
+        single producer single consumer byte stream
+
+        one contiguous ring, the writer fills it in place and the reader
+        looks at it in place, no chunk is allocated or moved:
+
+            auto buf = c.prepare(64 << 10);        // writer
+            auto n = ::read(fd, buf.data(), buf.size());
+            c.commit(n);
+
+            for (auto v = c.read_view(); !v.empty(); v = c.read_view()) {
+                ::write(out, v.data(), v.size()); // reader
+                c.consume(v.size());
+            }
+
+        every span is contiguous, also around the end of the ring: the ring
+        is a memfd mapped twice, back to back, so the bytes past the end are
+        the ones at the start. without memfd (or with double_map false) the
+        ring is one buffer with a spare capacity behind it, the few bytes
+        of a span crossing the end get copied to the other side.
+
+        parks like SpscChan. close() comes from the writer, the reader still
+        gets what was committed before.
+ */
+class ByteChan {
+  public:
+    // size is rounded up to a power of two pages
+    explicit ByteChan(size_t size, bool double_map = true);
+    ~ByteChan();
+    ByteChan(const ByteChan &) = delete;
+    ByteChan &operator=(const ByteChan &) = delete;
+
+    size_t capacity() const;
+    bool double_mapped() const;
+
+    void close();
+    bool closed();
+    bool exhausted(); // closed && nothing left to read
+    operator bool();  // !exhausted()
+
+    // writer: n free bytes, waits for them. empty once closed,
+    // std::length_error if n > capacity()
+    ByteSpan prepare(size_t n);
+    // publishes the first n bytes of the last prepare
+    void commit(size_t n);
+    // copies all of data through prepare / commit, less once closed
+    size_t write(const void *data, size_t n);
+
+    // reader: the bytes readable, at least min unless closed. empty once
+    // closed and drained, std::length_error if min > capacity()
+    ByteSpan read_view(size_t min = 1);
+    // drops the first n bytes of the view
+    void consume(size_t n);
+    // copies up to n bytes out, waits for at least one, 0 once exhausted
+    size_t read(void *data, size_t n);
+
+  private:
+    bool map_twice(); // false where memfd / mmap fail
+    bool writable(size_t n); // head_cache_ is reloaded when short
+    bool readable(size_t n); // tail_cache_ too
+    void wait_writable(size_t n);
+    void wait_readable(size_t n);
+    void wake(std::atomic<bool> &parked);
+
+    size_t cap_;
+    char *buf_ = nullptr;
+    bool double_mapped_ = false;
+
+    // writer owned
+    alignas(cache_line_size) std::atomic<size_t> tail_{0};
+    size_t head_cache_ = 0;
+    // reader owned
+    alignas(cache_line_size) std::atomic<size_t> head_{0};
+    size_t tail_cache_ = 0;
+    size_t mirrored_ = 0; // copied behind the end up to here, no memfd
+
+    alignas(cache_line_size) std::atomic<bool> closed_{false};
+    std::atomic<bool> writer_parked_{false};
+    std::atomic<bool> reader_parked_{false};
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+} // namespace goxx
+
+#include "goxx/byte_chan.ipp"
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "goxx/byte_chan.hpp"
+#include "goxx/defer.hpp"
+#include "goxx/executor.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace goxx {
+
+inline ByteChan::ByteChan(size_t size, bool double_map) {
+    size_t page = 4096;
+#ifdef __linux__
+    page = (size_t)::sysconf(_SC_PAGESIZE);
+#endif
+    cap_ = page;
+    while (cap_ < size) {
+        cap_ *= 2;
+    }
+    if (double_map && map_twice()) {
+        double_mapped_ = true;
+    } else {
+        // the second half only holds copies of bytes around the end
+        buf_ = new char[2 * cap_];
+    }
+}
+
+inline ByteChan::~ByteChan() {
+#ifdef __linux__
+    if (double_mapped_) {
+        ::munmap(buf_, 2 * cap_);
+        return;
+    }
+#endif
+    delete[] buf_;
+}
+
+/*
+    the address range is reserved as a whole first, the two MAP_FIXED
+    mappings of the memfd replace it, nothing else can land in between
+ */
+inline bool ByteChan::map_twice() {
+#ifdef __linux__
+    auto fd = ::memfd_create("goxx_byte_chan", MFD_CLOEXEC);
+    if (fd < 0)
+        return false;
+    goxx_defer([fd]() { ::close(fd); });
+    if (::ftruncate(fd, (off_t)cap_) != 0)
+        return false;
+    auto *mem = ::mmap(nullptr, 2 * cap_, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return false;
+    auto *base = static_cast<char *>(mem);
+    for (auto *half : {base, base + cap_}) {
+        if (::mmap(half, cap_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                   fd, 0) == MAP_FAILED) {
+            ::munmap(mem, 2 * cap_);
+            return false;
+        }
+    }
+    buf_ = base;
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline size_t ByteChan::capacity() const {
+    return cap_;
+}
+
+inline bool ByteChan::double_mapped() const {
+    return double_mapped_;
+}
+
+inline bool ByteChan::closed() {
+    return closed_.load(std::memory_order_acquire);
+}
+
+inline bool ByteChan::exhausted() {
+    return closed() && head_.load(std::memory_order_acquire) ==
+                           tail_.load(std::memory_order_acquire);
+}
+
+inline ByteChan::operator bool() {
+    return !exhausted();
+}
+
+inline void ByteChan::close() {
+    closed_.store(true, std::memory_order_seq_cst);
+    { auto lg = std::lock_guard{mtx_}; }
+    cv_.notify_all();
+}
+
+inline bool ByteChan::writable(size_t n) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (cap_ - (tail - head_cache_) >= n)
+        return true;
+    head_cache_ = head_.load(std::memory_order_acquire);
+    return cap_ - (tail - head_cache_) >= n;
+}
+
+inline bool ByteChan::readable(size_t n) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (tail_cache_ - head >= n)
+        return true;
+    tail_cache_ = tail_.load(std::memory_order_acquire);
+    return tail_cache_ - head >= n;
+}
+
+inline ByteSpan ByteChan::prepare(size_t n) {
+    if (n > cap_)
+        throw std::length_error("ByteChan::prepare past the capacity");
+    for (;;) {
+        if (closed())
+            return {};
+        if (writable(n))
+            break;
+        wait_writable(n);
+    }
+    auto tail = tail_.load(std::memory_order_relaxed);
+    return {buf_ + (tail & (cap_ - 1)), n};
+}
+
+inline void ByteChan::commit(size_t n) {
+    if (n == 0)
+        return;
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto off = tail & (cap_ - 1);
+    // what went past the end belongs to the start
+    if (!double_mapped_ && off + n > cap_)
+        std::memcpy(buf_, buf_ + cap_, off + n - cap_);
+    tail_.store(tail + n, std::memory_order_release);
+    wake(reader_parked_);
+}
+
+// a quarter of the ring at a time, the reader starts on the first one
+inline size_t ByteChan::write(const void *data, size_t n) {
+    auto *p = static_cast<const char *>(data);
+    size_t done = 0;
+    while (done < n) {
+        auto chunk = std::min(n - done, cap_ / 4);
+        auto buf = prepare(chunk);
+        if (buf.empty())
+            break;
+        std::memcpy(buf.data(), p + done, chunk);
+        commit(chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+inline ByteSpan ByteChan::read_view(size_t min) {
+    if (min > cap_)
+        throw std::length_error("ByteChan::read_view past the capacity");
+    min = std::max<size_t>(min, 1);
+    for (;;) {
+        if (readable(min))
+            break;
+        if (closed()) {
+            // the last commit may have landed right before close
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            break;
+        }
+        wait_readable(min);
+    }
+    auto head = head_.load(std::memory_order_relaxed);
+    auto n = tail_cache_ - head;
+    if (n == 0)
+        return {};
+    auto off = head & (cap_ - 1);
+    // the writer is not past the end while the reader is, the copy is
+    // free to use the second half. once per byte and lap
+    if (!double_mapped_ && off + n > cap_ && mirrored_ < off + n - cap_) {
+        std::memcpy(buf_ + cap_ + mirrored_, buf_ + mirrored_,
+                    off + n - cap_ - mirrored_);
+        mirrored_ = off + n - cap_;
+    }
+    return {buf_ + off, n};
+}
+
+inline void ByteChan::consume(size_t n) {
+    if (n == 0)
+        return;
+    auto head = head_.load(std::memory_order_relaxed);
+    if (((head ^ (head + n)) & ~(cap_ - 1)) != 0)
+        mirrored_ = 0;
+    head_.store(head + n, std::memory_order_release);
+    wake(writer_parked_);
+}
+
+inline size_t ByteChan::read(void *data, size_t n) {
+    if (n == 0)
+        return 0;
+    auto v = read_view();
+    if (v.empty())
+        return 0;
+    auto k = std::min(v.size(), n);
+    std::memcpy(data, v.data(), k);
+    consume(k);
+    return k;
+}
+
+/*
+    slow paths, the parked flag is raised before the ring is checked again
+    and wake() reads it after publishing, so one side always sees the other
+ */
+inline void ByteChan::wait_writable(size_t n) {
+    for (auto i = 0; i < 64; i++) {
+        if (closed() || writable(n))
+            return;
+        std::this_thread::yield();
+    }
+    Executor::Blocking blocking;
+    auto ul = std::unique_lock{mtx_};
+    writer_parked_.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_.wait(ul, [&]() { return closed() || writable(n); });
+    writer_parked_.store(false, std::memory_order_relaxed);
+}
+
+inline void ByteChan::wait_readable(size_t n) {
+    for (auto i = 0; i < 64; i++) {
+        if (closed() || readable(n))
+            return;
+        std::this_thread::yield();
+    }
+    Executor::Blocking blocking;
+    auto ul = std::unique_lock{mtx_};
+    reader_parked_.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_.wait(ul, [&]() { return closed() || readable(n); });
+    reader_parked_.store(false, std::memory_order_relaxed);
+}
+
+inline void ByteChan::wake(std::atomic<bool> &parked) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!parked.load(std::memory_order_relaxed))
+        return;
+    { auto lg = std::lock_guard{mtx_}; }
+    cv_.notify_all();
+}
+
+} // namespace goxx
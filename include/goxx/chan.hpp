@@ -1,18 +1,68 @@
 
 #pragma once
 
+#include "goxx/chan_stats.hpp"
 #include "goxx/defer.hpp"
+#include "goxx/executor.hpp"
+#include "goxx/padded.hpp"
+#include "goxx/selector.hpp"
+#include "goxx/spin.hpp"
+#include <atomic>
 #include <condition_variable>
-#include <functional>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <utility>
+#include <vector>
 
 namespace goxx {
+
+class Context;
+
+namespace internal {
+/*
+    a thread or a select parked on an unbuffered chan, lives on its stack.
+    the counterpart moves the value across and marks it done under the chan
+    lock, so the parked side never needs an allocation or a callback
+ */
+template <class T>
+struct Rendezvous {
+    T *value = nullptr;                 // parked sender
+    std::optional<T> *slot = nullptr;   // parked receiver
+    Selector *selector = nullptr;       // parked select, else cv
+    std::atomic<bool> *claim = nullptr; // shared by the cases of one select
+    std::atomic<bool> done{false};
+    std::condition_variable cv;
+    Rendezvous *prev = nullptr;
+    Rendezvous *next = nullptr;
+    bool queued = false;
+    goxx_chan_stat(uint64_t stamp = 0;) // sender queued at
+};
+
+// intrusive fifo of parked rendezvous
+template <class T>
+struct RendezvousQueue {
+    Rendezvous<T> *head = nullptr;
+    Rendezvous<T> *tail = nullptr;
+    void push(Rendezvous<T> *rv);
+    void remove(Rendezvous<T> *rv); // no-op unless queued
+};
+} // namespace internal
+
 /*
         GO style chan
 
         *NOTE* can use as range expression
+
+        buffered chan is a bounded lock free MPMC ring, every slot carries a
+        sequence number, head_ and tail_ live on their own cache lines.
+        threads only park when the ring is really full or empty, producers
+        on not_full_ and consumers on not_empty_, and every push / pop wakes
+        at most one parked thread per element, only if one is parked.
+
+        unbuffered chan hands values over directly, a parked sender or
+        receiver queues a stack allocated internal::Rendezvous that the
+        other side completes.
  */
 template <class T>
 class Chan {
@@ -22,19 +72,68 @@ class Chan {
 
      **************************************/
     // if size == 0 , it becomes synchronous unbuffered channel
-    Chan(size_t size);
+    // spin > 0 polls the ring up to spin times before parking
+    Chan(size_t size, size_t spin = 0);
 
     ~Chan(); // calls close
 
-    void close();     // set closed_
-    bool closed();    // check closed_
-    bool exhausted(); // check l_.empty && closed_
-    operator bool();  // check !(l_.empty && closed_)
+    void close();     // set closed bit of tail_
+    bool closed();    // check closed bit of tail_
+    bool exhausted(); // check ring empty && closed
+    operator bool();  // check !(ring empty && closed)
 
     bool push(T &&t);
     bool try_push(T &&t);
     std::optional<T> pop();
     std::optional<T> try_pop();
+    // same, but give up once ctx is cancelled and they would have to wait,
+    // false / nullopt then and t is left untouched. see context.hpp
+    bool push(T &&t, const Context &ctx);
+    std::optional<T> pop(const Context &ctx);
+
+    /***************************************
+         batch interface
+          one synchronization moves as many elements as the ring allows.
+          blocks until at least one element moved, returns how many moved,
+          0 once closed (push) or exhausted (pop).
+     ********************************/
+    template <class ForwardIt>
+    size_t push_range(ForwardIt first, ForwardIt last); // moves from range
+    template <class OutputIt>
+    size_t pop_into(OutputIt out, size_t max_n);
+
+    /***************************************
+         batched range expression
+          for (auto &batch : ch.batches(64)) { } // std::vector<T> &
+     ********************************/
+
+    class Batches {
+        friend class Chan;
+
+      public:
+        class Iterator {
+            friend class Batches;
+
+          public:
+            bool operator!=(const Iterator &end) const;
+            void operator++();
+            std::vector<T> &operator*();
+
+          private:
+            Iterator(Chan<T> &, size_t max_n);
+            Chan<T> &c_;
+            size_t max_n_;
+            std::vector<T> batch_;
+        };
+        Iterator begin();
+        Iterator end();
+
+      private:
+        Batches(Chan<T> &, size_t max_n);
+        Chan<T> &c_;
+        size_t max_n_;
+    };
+    Batches batches(size_t max_n);
 
     /***************************************
          range expression
@@ -57,27 +156,87 @@ class Chan {
     Iterator begin();
     Iterator end();
 
+    /***************************************
+         instrumentation, see chan_stats.hpp
+          no-ops without GOXX_CHAN_STATS
+     ********************************/
+    void set_name(std::string name);
+    ChanStats stats();
+
   private:
-    bool push_buffered(T &&t);
-    bool push_unbuffered(T &&t);
+    friend struct internal::ChanAccess;
+
+    // top bit of tail_, once set no producer can claim a slot
+    static constexpr size_t closed_bit = ~(~size_t{0} >> 1);
+
+    // seq is 2 * pos while free for the producer of pos, 2 * pos + 1 once
+    // published, doubling keeps the two states apart even for size 1
+    struct Slot {
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+        goxx_chan_stat(uint64_t stamp;) // enqueued at, sampled slots only
+        T *value();
+    };
+
+    enum class Status { ok, full, empty, closed };
+
+    bool push_buffered(T &&t, const Context &ctx);
+    bool push_unbuffered(T &&t, const Context &ctx);
     bool try_push_buffered(T &&t);
     bool try_push_unbuffered(T &&t);
 
-    std::optional<T> pop_buffered();
-    std::optional<T> pop_unbuffered();
+    std::optional<T> pop_buffered(const Context &ctx);
+    std::optional<T> pop_unbuffered(const Context &ctx);
     std::optional<T> try_pop_buffered();
     std::optional<T> try_pop_unbuffered();
-
-    size_t next_idx(size_t idx) const;
-    bool buffer_empty() const;
-    bool closed_ = false;
-    std::optional<T> popt();
+    // unbuffered, mtx_ held: complete the first parked counterpart
+    bool handoff(T &t);
+    bool take(std::optional<T> &res);
+    bool claim(internal::Rendezvous<T> *rv);
+    void complete(internal::Rendezvous<T> *rv);
+
+    Status enqueue(T &&t);
+    Status dequeue(std::optional<T> &res);
+    template <class ForwardIt>
+    size_t enqueue_n(ForwardIt &first, size_t n);
+    template <class OutputIt>
+    size_t dequeue_n(OutputIt &out, size_t max_n);
+    bool ring_full() const;
+    bool ring_empty() const; // no slot claimed by a producer is left
+    bool ring_ready() const; // next slot to pop is published
+    template <class Pred>
+    void park(std::atomic<size_t> &parked, std::condition_variable &cv,
+              Pred &&pred);
+    // wake up to n threads parked on cv
+    void wake(std::atomic<size_t> &parked, std::condition_variable &cv,
+              size_t n);
+    void wake_producers(size_t n = 1);
+    void wake_consumers(size_t n = 1);
+    void signal_selectors(); // mtx_ held
+    // every parked thread and select rechecks, on close and cancel
+    void interrupt();
+
+    // select support, a registered selector counts as parked on both sides.
+    // on an unbuffered chan the select's rendezvous queues up as well
+    void attach(internal::Selector *s,
+                internal::Rendezvous<T> *rv = nullptr, bool sender = false);
+    void detach(internal::Selector *s,
+                internal::Rendezvous<T> *rv = nullptr, bool sender = false);
+
+    const size_t size_;
+    const size_t spin_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(cache_line_size) std::atomic<size_t> head_{0};
+    alignas(cache_line_size) std::atomic<size_t> tail_{0};
+    alignas(cache_line_size) std::atomic<size_t> producers_parked_{0};
+    alignas(cache_line_size) std::atomic<size_t> consumers_parked_{0};
     std::mutex mtx_;
-    std::condition_variable cv_;
-    std::vector<std::optional<T>> buffer_;
-    std::function<void(T &&)> consumer_;
-    size_t ridx_ = 0;
-    size_t widx_ = 0;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    internal::RendezvousQueue<T> senders_;
+    internal::RendezvousQueue<T> receivers_;
+    std::vector<internal::Selector *> selectors_;
+    goxx_chan_stat(internal::ChanCounters stats_; size_t stats_id_;)
 };
 
 } // namespace goxx
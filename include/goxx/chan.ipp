@@ -2,29 +2,56 @@
 #pragma once
 
 #include "goxx/chan.hpp"
+#include "goxx/context.hpp"
+#include <algorithm>
+#include <iterator>
+#include <new>
 #include <thread>
 
 namespace goxx {
 
 template <class T>
-Chan<T>::Chan(size_t size) : buffer_(size) {}
+Chan<T>::Chan(size_t size, size_t spin)
+    : size_(size), spin_(spin), slots_(size ? new Slot[size] : nullptr) {
+    for (size_t i = 0; i < size_; i++) {
+        slots_[i].seq.store(2 * i, std::memory_order_relaxed);
+    }
+    goxx_chan_stat(stats_id_ = internal::ChanRegistry::instance().add(
+                       [this]() { return stats(); });)
+}
 
 template <class T>
 Chan<T>::~Chan() {
+    goxx_chan_stat(internal::ChanRegistry::instance().remove(stats_id_);)
     close();
+    if (size_ == 0)
+        return;
+    // destroy whatever nobody popped
+    auto tail = tail_.load(std::memory_order_acquire) & ~closed_bit;
+    for (auto pos = head_.load(std::memory_order_acquire); pos != tail;
+         pos++) {
+        auto &slot = slots_[pos % size_];
+        if (slot.seq.load(std::memory_order_acquire) == 2 * pos + 1) {
+            slot.value()->~T();
+        }
+    }
+}
+
+template <class T>
+T *Chan<T>::Slot::value() {
+    return std::launder(reinterpret_cast<T *>(storage));
 }
 
 template <class T>
 bool Chan<T>::closed() {
-    return closed_;
+    return tail_.load(std::memory_order_acquire) & closed_bit;
 }
 
 template <class T>
 bool Chan<T>::exhausted() {
-    auto ul = std::unique_lock{mtx_};
-    auto res = closed_ && buffer_empty();
-    ul.unlock();
-    return res;
+    if (size_ == 0)
+        return closed();
+    return closed() && ring_empty();
 }
 
 template <class T>
@@ -32,205 +59,694 @@ Chan<T>::operator bool() {
     return !exhausted();
 }
 
+/*
+    taking mtx_ also makes sure a waiter between its check and its wait can
+    not miss the close
+ */
 template <class T>
 void Chan<T>::close() {
-    closed_ = true;
-    cv_.notify_all();
+    tail_.fetch_or(closed_bit, std::memory_order_seq_cst);
+    interrupt();
+}
+
+template <class T>
+void Chan<T>::interrupt() {
+    {
+        auto lg = std::lock_guard{mtx_};
+        signal_selectors();
+        for (auto queue : {&senders_, &receivers_}) {
+            for (auto rv = queue->head; rv; rv = rv->next) {
+                if (!rv->selector)
+                    rv->cv.notify_one();
+            }
+        }
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
 }
 
 template <class T>
 bool Chan<T>::push(T &&t) {
-    if (buffer_.empty())
-        return push_unbuffered(std::move(t));
-    return push_buffered(std::move(t));
+    return push(std::move(t), Context{});
 }
 
 template <class T>
-bool Chan<T>::push_unbuffered(T &&t) {
+bool Chan<T>::push(T &&t, const Context &ctx) {
+    if (size_ == 0)
+        return push_unbuffered(std::move(t), ctx);
+    return push_buffered(std::move(t), ctx);
+}
+
+/*
+    cancel() takes mtx_ with the context locked, so the hook is registered
+    before mtx_ and goes after it. like the buffered side, a cancelled ctx
+    only counts when there is no counterpart to pair with
+ */
+template <class T>
+bool Chan<T>::push_unbuffered(T &&t, const Context &ctx) {
+    std::optional<internal::CancelHook> hook;
     auto ul = std::unique_lock{mtx_};
-    cv_.wait(ul, [&]() { return closed_ || consumer_; });
-    if (closed_) {
+    for (;;) {
+        if (closed())
+            return false;
+        if (handoff(t))
+            return true;
+        if (ctx.cancelled())
+            return false;
+        if (hook)
+            break;
         ul.unlock();
-        cv_.notify_all();
+        hook.emplace(ctx, [this]() { interrupt(); });
+        ul.lock();
+    }
+    internal::Rendezvous<T> rv;
+    rv.value = &t;
+    goxx_chan_stat(rv.stamp = internal::ChanCounters::now();)
+    senders_.push(&rv);
+    // a select may be waiting to receive
+    signal_selectors();
+    Executor::Blocking blocking;
+    rv.cv.wait(ul, [&]() {
+        return rv.done.load(std::memory_order_relaxed) || closed() ||
+               ctx.cancelled();
+    });
+    goxx_chan_stat(stats_.push_blocked(rv.stamp);)
+    if (!rv.done.load(std::memory_order_relaxed)) {
+        senders_.remove(&rv);
         return false;
     }
-    consumer_(std::move(t));
-    consumer_ = nullptr;
-    ul.unlock();
-    cv_.notify_all();
     return true;
 }
 
+/*
+    a queued rendezvous of a select is only taken if its claim flips, the
+    select holds the claim itself while it polls, so it never fires twice
+    and never pairs with itself
+ */
 template <class T>
-bool Chan<T>::push_buffered(T &&t) {
-    auto ul = std::unique_lock{mtx_};
-    cv_.wait(ul, [&]() { return closed_ || !buffer_[widx_]; });
-    if (closed_) {
-        ul.unlock();
-        cv_.notify_all();
-        return false;
+bool Chan<T>::claim(internal::Rendezvous<T> *rv) {
+    if (!rv->claim)
+        return true;
+    auto expected = false;
+    return rv->claim->compare_exchange_strong(expected, true);
+}
+
+// mtx_ held, so the parked side can not leave before it is notified
+template <class T>
+void Chan<T>::complete(internal::Rendezvous<T> *rv) {
+    rv->done.store(true, std::memory_order_release);
+    if (rv->selector) {
+        rv->selector->signal();
+    } else {
+        rv->cv.notify_one();
     }
+}
 
-    buffer_[widx_] = std::move(t);
-    widx_ = next_idx(widx_);
-    ul.unlock();
-    cv_.notify_all();
-    return true;
+template <class T>
+bool Chan<T>::handoff(T &t) {
+    for (auto rv = receivers_.head; rv; rv = rv->next) {
+        if (!claim(rv))
+            continue;
+        receivers_.remove(rv);
+        rv->slot->emplace(std::move(t));
+        goxx_chan_stat(stats_.handoffs++;
+                       stats_.latency(internal::ChanCounters::now());)
+        complete(rv);
+        return true;
+    }
+    return false;
 }
 
 template <class T>
-size_t Chan<T>::next_idx(size_t idx) const {
-    ++idx;
-    if (idx >= buffer_.size())
-        idx = 0;
-    return idx;
+bool Chan<T>::take(std::optional<T> &res) {
+    for (auto rv = senders_.head; rv; rv = rv->next) {
+        if (!claim(rv))
+            continue;
+        senders_.remove(rv);
+        res.emplace(std::move(*rv->value));
+        goxx_chan_stat(stats_.handoffs++; stats_.latency(rv->stamp);)
+        complete(rv);
+        return true;
+    }
+    return false;
 }
+
+/*
+    cancelled only counts once the ring is full, so leaving never swallows
+    a wake up meant for a slot
+ */
 template <class T>
-bool Chan<T>::buffer_empty() const {
-    return !buffer_[ridx_];
+bool Chan<T>::push_buffered(T &&t, const Context &ctx) {
+    std::optional<internal::CancelHook> hook;
+    for (;;) {
+        switch (enqueue(std::move(t))) {
+        case Status::ok:
+            wake_consumers();
+            return true;
+        case Status::closed:
+            return false;
+        default:
+            if (ctx.cancelled())
+                return false;
+            if (!hook)
+                hook.emplace(ctx, [this]() { interrupt(); });
+            park(producers_parked_, not_full_, [&]() {
+                return closed() || !ring_full() || ctx.cancelled();
+            });
+        }
+    }
 }
 
+/*
+    claim tail_ slot, move t in and publish it.
+    t is left untouched unless Status::ok is returned
+ */
 template <class T>
-bool Chan<T>::try_push(T &&t) {
-    if (buffer_.empty()) {
-        return try_push_unbuffered(std::move(t));
+typename Chan<T>::Status Chan<T>::enqueue(T &&t) {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        if (pos & closed_bit)
+            return Status::closed;
+        slot = &slots_[pos % size_];
+        auto seq = slot->seq.load(std::memory_order_acquire);
+        auto dif = (std::ptrdiff_t)(seq - 2 * pos);
+        if (dif == 0) {
+            if (tail_.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            goxx_chan_stat(stats_.occupancy(size_);)
+            return Status::full;
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
     }
-    return try_push_buffered(std::move(t));
+    new (slot->storage) T(std::move(t));
+    goxx_chan_stat(if (pos % GOXX_CHAN_STATS_SAMPLE == 0) {
+        slot->stamp = internal::ChanCounters::now();
+        stats_.occupancy(pos + 1 - head_.load(std::memory_order_relaxed));
+    })
+    slot->seq.store(2 * pos + 1, std::memory_order_release);
+    return Status::ok;
 }
 
+/*
+    claim head_ slot, move its value into res and release the slot.
+    Status::empty also covers a producer still filling the head slot
+ */
 template <class T>
-bool Chan<T>::try_push_buffered(T &&t) {
-    auto ul = std::unique_lock{mtx_, std::defer_lock};
-    if (!ul.try_lock()) {
-        cv_.notify_all();
-        return false;
+typename Chan<T>::Status Chan<T>::dequeue(std::optional<T> &res) {
+    auto pos = head_.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        slot = &slots_[pos % size_];
+        auto seq = slot->seq.load(std::memory_order_acquire);
+        auto dif = (std::ptrdiff_t)(seq - (2 * pos + 1));
+        if (dif == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return Status::empty;
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
     }
-    if (closed_) {
-        ul.unlock();
-        cv_.notify_all();
-        return false;
+    res.emplace(std::move(*slot->value()));
+    slot->value()->~T();
+    goxx_chan_stat(if (pos % GOXX_CHAN_STATS_SAMPLE == 0) {
+        stats_.latency(slot->stamp);
+    })
+    slot->seq.store(2 * (pos + size_), std::memory_order_release);
+    return Status::ok;
+}
+
+/*
+    claim up to n consecutive free slots with a single CAS on tail_.
+    a slot seen free can only be taken by whoever moves tail_ past it,
+    so the CAS failing is the only way the scan goes stale
+ */
+template <class T>
+template <class ForwardIt>
+size_t Chan<T>::enqueue_n(ForwardIt &first, size_t n) {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    size_t k;
+    for (;;) {
+        if (pos & closed_bit)
+            return 0;
+        std::ptrdiff_t dif = 0;
+        for (k = 0; k < n && k < size_; k++) {
+            auto seq = slots_[(pos + k) % size_].seq.load(
+                std::memory_order_acquire);
+            dif = (std::ptrdiff_t)(seq - 2 * (pos + k));
+            if (dif != 0)
+                break;
+        }
+        if (k == 0) {
+            if (dif < 0) {
+                goxx_chan_stat(stats_.occupancy(size_);)
+                return 0; // full
+            }
+            pos = tail_.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (tail_.compare_exchange_weak(pos, pos + k,
+                                        std::memory_order_relaxed))
+            break;
     }
-    auto res = false;
-    if (!buffer_[widx_]) {
-        buffer_[widx_] = std::move(t);
-        widx_ = next_idx(widx_);
-        res = true;
+    for (size_t i = 0; i < k; i++, ++first) {
+        auto &slot = slots_[(pos + i) % size_];
+        new (slot.storage) T(std::move(*first));
+        goxx_chan_stat(if ((pos + i) % GOXX_CHAN_STATS_SAMPLE == 0) {
+            slot.stamp = internal::ChanCounters::now();
+            stats_.occupancy(pos + k - head_.load(std::memory_order_relaxed));
+        })
+        slot.seq.store(2 * (pos + i) + 1, std::memory_order_release);
     }
-    ul.unlock();
-    cv_.notify_all();
-    return res;
+    return k;
 }
 
 template <class T>
-bool Chan<T>::try_push_unbuffered(T &&t) {
-    auto ul = std::unique_lock{mtx_, std::defer_lock};
-    if (!ul.try_lock()) {
-        cv_.notify_all();
-        return false;
+template <class OutputIt>
+size_t Chan<T>::dequeue_n(OutputIt &out, size_t max_n) {
+    auto pos = head_.load(std::memory_order_relaxed);
+    size_t k;
+    for (;;) {
+        std::ptrdiff_t dif = 0;
+        for (k = 0; k < max_n && k < size_; k++) {
+            auto seq = slots_[(pos + k) % size_].seq.load(
+                std::memory_order_acquire);
+            dif = (std::ptrdiff_t)(seq - (2 * (pos + k) + 1));
+            if (dif != 0)
+                break;
+        }
+        if (k == 0) {
+            if (dif < 0)
+                return 0; // empty
+            pos = head_.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (head_.compare_exchange_weak(pos, pos + k,
+                                        std::memory_order_relaxed))
+            break;
     }
-    if (closed_) {
-        ul.unlock();
-        cv_.notify_all();
-        return false;
+    for (size_t i = 0; i < k; i++) {
+        auto &slot = slots_[(pos + i) % size_];
+        *out = std::move(*slot.value());
+        ++out;
+        slot.value()->~T();
+        goxx_chan_stat(if ((pos + i) % GOXX_CHAN_STATS_SAMPLE == 0) {
+            stats_.latency(slot.stamp);
+        })
+        slot.seq.store(2 * (pos + i + size_), std::memory_order_release);
     }
-    if (!consumer_) {
-        ul.unlock();
-        cv_.notify_all();
+    return k;
+}
+
+template <class T>
+bool Chan<T>::ring_full() const {
+    auto pos = tail_.load(std::memory_order_seq_cst) & ~closed_bit;
+    auto seq = slots_[pos % size_].seq.load(std::memory_order_seq_cst);
+    return (std::ptrdiff_t)(seq - 2 * pos) < 0;
+}
+
+template <class T>
+bool Chan<T>::ring_empty() const {
+    return head_.load(std::memory_order_seq_cst) ==
+           (tail_.load(std::memory_order_seq_cst) & ~closed_bit);
+}
+
+template <class T>
+bool Chan<T>::ring_ready() const {
+    auto pos = head_.load(std::memory_order_seq_cst);
+    auto seq = slots_[pos % size_].seq.load(std::memory_order_seq_cst);
+    return (std::ptrdiff_t)(seq - (2 * pos + 1)) >= 0;
+}
+
+/*
+    slow path, optionally spin, then block on cv until pred holds.
+    parked is raised before pred is checked under mtx_, wake() reads it
+    after publishing, so one of the two always sees the other
+ */
+template <class T>
+template <class Pred>
+void Chan<T>::park(std::atomic<size_t> &parked, std::condition_variable &cv,
+                   Pred &&pred) {
+    for (size_t i = 0; i < spin_; i++) {
+        if (pred())
+            return;
+        cpu_relax();
+    }
+    Executor::Blocking blocking;
+    goxx_chan_stat(auto since = internal::ChanCounters::now();)
+    auto ul = std::unique_lock{mtx_};
+    parked.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv.wait(ul, pred);
+    parked.fetch_sub(1, std::memory_order_relaxed);
+    goxx_chan_stat(&parked == &producers_parked_ ? stats_.push_blocked(since)
+                                                 : stats_.pop_blocked(since);)
+}
+
+/*
+    one element frees / fills one slot, so one waiter per element is enough.
+    a woken thread that loses the slot to a running one just parks again
+ */
+template <class T>
+void Chan<T>::wake(std::atomic<size_t> &parked, std::condition_variable &cv,
+                   size_t n) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto waiting = parked.load(std::memory_order_relaxed);
+    if (waiting == 0)
+        return;
+    {
+        auto lg = std::lock_guard{mtx_};
+        signal_selectors();
+    }
+    if (n >= waiting) {
+        cv.notify_all();
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        cv.notify_one();
+    }
+}
+
+template <class T>
+void Chan<T>::wake_producers(size_t n) {
+    wake(producers_parked_, not_full_, n);
+}
+
+template <class T>
+void Chan<T>::wake_consumers(size_t n) {
+    wake(consumers_parked_, not_empty_, n);
+}
+
+template <class T>
+void Chan<T>::signal_selectors() {
+    for (auto s : selectors_) {
+        s->signal();
+    }
+}
+
+template <class T>
+void Chan<T>::attach(internal::Selector *s, internal::Rendezvous<T> *rv,
+                     bool sender) {
+    auto lg = std::lock_guard{mtx_};
+    if (size_ == 0 && rv) {
+        goxx_chan_stat(rv->stamp = internal::ChanCounters::now();)
+        (sender ? senders_ : receivers_).push(rv);
+    }
+    selectors_.push_back(s);
+    producers_parked_.fetch_add(1, std::memory_order_seq_cst);
+    consumers_parked_.fetch_add(1, std::memory_order_seq_cst);
+}
+
+template <class T>
+void Chan<T>::detach(internal::Selector *s, internal::Rendezvous<T> *rv,
+                     bool sender) {
+    auto lg = std::lock_guard{mtx_};
+    if (rv) {
+        (sender ? senders_ : receivers_).remove(rv);
+    }
+    if (auto itr = std::find(selectors_.begin(), selectors_.end(), s);
+        itr != selectors_.end()) {
+        selectors_.erase(itr);
+        producers_parked_.fetch_sub(1, std::memory_order_relaxed);
+        consumers_parked_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+template <class T>
+bool Chan<T>::try_push(T &&t) {
+    if (size_ == 0) {
+        return try_push_unbuffered(std::move(t));
+    }
+    return try_push_buffered(std::move(t));
+}
+
+template <class T>
+bool Chan<T>::try_push_buffered(T &&t) {
+    if (enqueue(std::move(t)) != Status::ok) {
+        goxx_chan_stat(stats_.try_push_failed();)
         return false;
     }
-    consumer_(std::move(t));
-    consumer_ = nullptr;
-    ul.unlock();
-    cv_.notify_all();
+    wake_consumers();
     return true;
 }
 
+template <class T>
+bool Chan<T>::try_push_unbuffered(T &&t) {
+    auto lg = std::lock_guard{mtx_};
+    if (!closed() && handoff(t))
+        return true;
+    goxx_chan_stat(stats_.try_push_failed();)
+    return false;
+}
+
 template <class T>
 std::optional<T> Chan<T>::pop() {
-    if (buffer_.empty())
-        return pop_unbuffered();
-    return pop_buffered();
+    return pop(Context{});
 }
+
 template <class T>
-std::optional<T> Chan<T>::pop_buffered() {
-    auto ul = std::unique_lock{mtx_};
-    cv_.wait(ul, [&]() { return !buffer_empty() || closed_; });
-    auto res = popt();
-    ul.unlock();
-    cv_.notify_all();
-    return std::move(res);
+std::optional<T> Chan<T>::pop(const Context &ctx) {
+    if (size_ == 0)
+        return pop_unbuffered(ctx);
+    return pop_buffered(ctx);
 }
 
 template <class T>
-std::optional<T> Chan<T>::pop_unbuffered() {
+std::optional<T> Chan<T>::pop_buffered(const Context &ctx) {
+    std::optional<internal::CancelHook> hook;
+    std::optional<T> res;
+    for (;;) {
+        if (dequeue(res) == Status::ok) {
+            wake_producers();
+            return res;
+        }
+        if (closed()) {
+            if (ring_empty())
+                return std::nullopt;
+            // a producer claimed a slot before close, wait for it to publish
+            std::this_thread::yield();
+            continue;
+        }
+        if (ctx.cancelled())
+            return std::nullopt;
+        if (!hook)
+            hook.emplace(ctx, [this]() { interrupt(); });
+        park(consumers_parked_, not_empty_,
+             [&]() { return closed() || ring_ready() || ctx.cancelled(); });
+    }
+}
+
+template <class T>
+std::optional<T> Chan<T>::pop_unbuffered(const Context &ctx) {
+    std::optional<internal::CancelHook> hook;
     auto ul = std::unique_lock{mtx_};
-    cv_.wait(ul, [&]() { return !consumer_ || closed_; });
-    if (closed_) {
+    std::optional<T> res;
+    for (;;) {
+        if (closed() || take(res) || ctx.cancelled())
+            return res;
+        if (hook)
+            break;
         ul.unlock();
-        cv_.notify_all();
-        return std::nullopt;
+        hook.emplace(ctx, [this]() { interrupt(); });
+        ul.lock();
     }
-    std::optional<T> res;
-    consumer_ = [&res](T &&t) { res = std::move(t); };
-    cv_.notify_all();
-    cv_.wait(ul, [&]() { return res.has_value() || closed_; });
-    consumer_ = nullptr;
-    ul.unlock();
-    cv_.notify_all();
-    return std::move(res);
+    internal::Rendezvous<T> rv;
+    rv.slot = &res;
+    receivers_.push(&rv);
+    // a select may be waiting to send
+    signal_selectors();
+    Executor::Blocking blocking;
+    goxx_chan_stat(auto since = internal::ChanCounters::now();)
+    rv.cv.wait(ul, [&]() {
+        return rv.done.load(std::memory_order_relaxed) || closed() ||
+               ctx.cancelled();
+    });
+    goxx_chan_stat(stats_.pop_blocked(since);)
+    if (!rv.done.load(std::memory_order_relaxed)) {
+        receivers_.remove(&rv);
+    }
+    return res;
 }
 
 template <class T>
 std::optional<T> Chan<T>::try_pop() {
-    if (buffer_.empty())
+    if (size_ == 0)
         return try_pop_unbuffered();
     return try_pop_buffered();
 }
 
 template <class T>
 std::optional<T> Chan<T>::try_pop_buffered() {
-    auto ul = std::unique_lock{mtx_, std::defer_lock};
-    if (!ul.try_lock()) {
-        cv_.notify_all();
-        return std::nullopt;
+    std::optional<T> res;
+    if (dequeue(res) == Status::ok) {
+        wake_producers();
+    } else {
+        goxx_chan_stat(stats_.try_pop_failed();)
     }
-    auto res = popt();
-    ul.unlock();
-    cv_.notify_all();
-    return std::move(res);
+    return res;
 }
 
 template <class T>
 std::optional<T> Chan<T>::try_pop_unbuffered() {
-    auto ul = std::unique_lock{mtx_, std::defer_lock};
-    if (!ul.try_lock()) {
-        cv_.notify_all();
-        return std::nullopt;
+    auto lg = std::lock_guard{mtx_};
+    std::optional<T> res;
+    if (!closed())
+        take(res);
+    goxx_chan_stat(if (!res) stats_.try_pop_failed();)
+    return res;
+}
+
+template <class T>
+void internal::RendezvousQueue<T>::push(Rendezvous<T> *rv) {
+    rv->prev = tail;
+    rv->next = nullptr;
+    if (tail) {
+        tail->next = rv;
+    } else {
+        head = rv;
     }
-    if (consumer_) {
-        ul.unlock();
-        cv_.notify_all();
-        return std::nullopt;
+    tail = rv;
+    rv->queued = true;
+}
+
+template <class T>
+void internal::RendezvousQueue<T>::remove(Rendezvous<T> *rv) {
+    if (!rv->queued)
+        return;
+    (rv->prev ? rv->prev->next : head) = rv->next;
+    (rv->next ? rv->next->prev : tail) = rv->prev;
+    rv->prev = rv->next = nullptr;
+    rv->queued = false;
+}
+
+/* instrumentation */
+
+template <class T>
+void Chan<T>::set_name(std::string name) {
+    goxx_chan_stat(auto lg = std::lock_guard{mtx_};
+                   stats_.name = std::move(name);)
+    (void)name;
+}
+
+template <class T>
+ChanStats Chan<T>::stats() {
+    ChanStats s;
+    s.capacity = size_;
+    goxx_chan_stat(auto lg = std::lock_guard{mtx_}; s.name = stats_.name;
+                   stats_.fill(s);)
+    if (size_ > 0) {
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_relaxed) & ~closed_bit;
+        s.pushes = tail; // claimed slots, a few may still be in flight
+        s.pops = head;
+        s.occupancy = std::min(size_, tail - std::min(head, tail));
+    } else {
+        goxx_chan_stat(s.pushes = s.pops = stats_.handoffs;
+                       for (auto rv = senders_.head; rv; rv = rv->next) {
+                           s.occupancy++;
+                       })
     }
-    std::optional<T> res;
-    consumer_ = [&res](T &&t) { res = std::move(t); };
-    ul.unlock();
-    cv_.notify_all();
-    this_thread::yield();
-    ul.lock();
-    consumer_ = nullptr;
-    ul.unlock();
-    cv_.notify_all();
-    return std::move(res);
+    return s;
 }
 
+/* batch interface */
+
 template <class T>
-std::optional<T> Chan<T>::popt() {
-    std::optional<T> res;
-    res.swap(buffer_[ridx_]);
-    ridx_ = next_idx(ridx_);
-    return std::move(res);
+template <class ForwardIt>
+size_t Chan<T>::push_range(ForwardIt first, ForwardIt last) {
+    auto n = (size_t)std::distance(first, last);
+    if (n == 0)
+        return 0;
+    if (size_ == 0)
+        return push_unbuffered(std::move(*first), Context{}) ? 1 : 0;
+    for (;;) {
+        if (auto k = enqueue_n(first, n); k > 0) {
+            wake_consumers(k);
+            return k;
+        }
+        if (closed())
+            return 0;
+        park(producers_parked_, not_full_,
+             [&]() { return closed() || !ring_full(); });
+    }
+}
+
+template <class T>
+template <class OutputIt>
+size_t Chan<T>::pop_into(OutputIt out, size_t max_n) {
+    if (max_n == 0)
+        return 0;
+    if (size_ == 0) {
+        auto res = pop_unbuffered(Context{});
+        if (!res)
+            return 0;
+        *out = std::move(*res);
+        return 1;
+    }
+    for (;;) {
+        if (auto k = dequeue_n(out, max_n); k > 0) {
+            wake_producers(k);
+            return k;
+        }
+        if (closed()) {
+            if (ring_empty())
+                return 0;
+            // a producer claimed a slot before close, wait for it to publish
+            std::this_thread::yield();
+            continue;
+        }
+        park(consumers_parked_, not_empty_,
+             [&]() { return closed() || ring_ready(); });
+    }
+}
+
+template <class T>
+typename Chan<T>::Batches Chan<T>::batches(size_t max_n) {
+    return Batches{*this, max_n};
+}
+
+template <class T>
+Chan<T>::Batches::Batches(Chan<T> &c, size_t max_n) : c_(c), max_n_(max_n) {}
+
+template <class T>
+typename Chan<T>::Batches::Iterator Chan<T>::Batches::begin() {
+    Iterator res{c_, max_n_};
+    ++res;
+    return res;
+}
+
+template <class T>
+typename Chan<T>::Batches::Iterator Chan<T>::Batches::end() {
+    return Iterator{c_, 0};
+}
+
+template <class T>
+Chan<T>::Batches::Iterator::Iterator(Chan<T> &c, size_t max_n)
+    : c_(c), max_n_(max_n) {}
+
+template <class T>
+bool Chan<T>::Batches::Iterator::operator!=(const Iterator &) const {
+    return !batch_.empty();
+}
+
+template <class T>
+std::vector<T> &Chan<T>::Batches::Iterator::operator*() {
+    return batch_;
 }
+
+/* the vector is reused, so steady state batching does not allocate */
+template <class T>
+void Chan<T>::Batches::Iterator::operator++() {
+    batch_.clear();
+    c_.pop_into(std::back_inserter(batch_), max_n_);
+}
+
 /* range expression */
 
 /* begin iterator */
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "goxx/padded.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+    per chan instrumentation, compiled in only with GOXX_CHAN_STATS defined
+    (cmake -DGOXX_CHAN_STATS=ON). without it Chan carries no counters, no
+    hooks and no registry entry, set_name() is a no-op, stats() only has
+    what a buffered ring tells for free (capacity, pushes, pops, occupancy)
+    and the registry comes back empty.
+
+    the fast path of a buffered chan only gains a branch: pushes and pops
+    are read off tail_ and head_, and 1 in GOXX_CHAN_STATS_SAMPLE elements
+    is timestamped when enqueued, its enqueue to dequeue latency goes into
+    the histogram and the same push samples the occupancy for the high water
+    mark. a push finding the ring full sets the high water mark to the
+    capacity. everything else is counted on slow paths only, in cache line
+    padded shards. an unbuffered chan counts and times every handoff.
+ */
+#ifndef GOXX_CHAN_STATS_SAMPLE
+#define GOXX_CHAN_STATS_SAMPLE 64
+#endif
+
+#ifdef GOXX_CHAN_STATS
+#define goxx_chan_stat(...) __VA_ARGS__
+#else
+#define goxx_chan_stat(...)
+#endif
+
+namespace goxx {
+
+/*
+    log linear histogram of nanoseconds, HDR style: values below 8 get a
+    bucket each, every power of two above is split in 8, so a bucket is at
+    most 12.5% wide
+ */
+class Histogram {
+  public:
+    static constexpr size_t sub_bits = 3;
+    static constexpr size_t sub_count = size_t{1} << sub_bits;
+    static constexpr size_t bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    static size_t bucket(uint64_t v);
+    static uint64_t bucket_low(size_t idx);
+    static uint64_t bucket_high(size_t idx);
+
+    void record(uint64_t v, uint64_t n = 1);
+    void merge(const Histogram &other);
+
+    uint64_t count() const { return count_; }
+    // highest value of the bucket holding the p-th percentile, p in [0, 100]
+    uint64_t percentile(double p) const;
+    uint64_t max() const;
+    const std::array<uint64_t, bucket_count> &counts() const {
+        return counts_;
+    }
+
+  private:
+    std::array<uint64_t, bucket_count> counts_{};
+    uint64_t count_ = 0;
+};
+
+// a snapshot of one chan
+struct ChanStats {
+    std::string name;
+    size_t capacity = 0;
+    uint64_t pushes = 0;
+    uint64_t pops = 0;
+    uint64_t try_push_failed = 0; // select polls count here too
+    uint64_t try_pop_failed = 0;
+    std::chrono::nanoseconds push_blocked{0}; // summed over threads
+    std::chrono::nanoseconds pop_blocked{0};
+    size_t occupancy = 0; // buffered elements, or parked senders
+    size_t high_water = 0;
+    Histogram latency; // enqueue to dequeue, sampled
+};
+
+// snapshots of every live chan, empty without GOXX_CHAN_STATS
+std::vector<ChanStats> chan_stats();
+void dump_chan_stats(std::FILE *out = stderr);
+
+namespace internal {
+
+/*
+    live counters of one chan. the atomic ones are spread over cache line
+    padded shards, a thread always hits the same shard
+ */
+class ChanCounters {
+  public:
+    static constexpr size_t shard_count = 16;
+
+    static uint64_t now(); // steady clock, ns
+
+    void try_push_failed();
+    void try_pop_failed();
+    void push_blocked(uint64_t since);
+    void pop_blocked(uint64_t since);
+    void occupancy(size_t n); // raises the high water mark
+    void latency(uint64_t since);
+
+    void fill(ChanStats &s) const; // the fields counted here
+
+    std::string name;
+    uint64_t handoffs = 0; // unbuffered, under the chan lock
+
+  private:
+    struct alignas(cache_line_size) Shard {
+        std::atomic<uint64_t> try_push_failed{0};
+        std::atomic<uint64_t> try_pop_failed{0};
+        std::atomic<uint64_t> push_blocked{0};
+        std::atomic<uint64_t> pop_blocked{0};
+    };
+    Shard &shard();
+
+    std::array<Shard, shard_count> shards_;
+    alignas(cache_line_size) std::atomic<size_t> high_water_{0};
+    std::array<std::atomic<uint64_t>, Histogram::bucket_count> latency_{};
+};
+
+// live chans, a chan adds itself on construction and leaves on destruction
+class ChanRegistry {
+  public:
+    static ChanRegistry &instance();
+
+    size_t add(std::function<ChanStats()> snapshot);
+    void remove(size_t id);
+    std::vector<ChanStats> snapshot();
+
+  private:
+    std::mutex mtx_;
+    size_t next_id_ = 0;
+    std::vector<std::pair<size_t, std::function<ChanStats()>>> chans_;
+};
+
+} // namespace internal
+} // namespace goxx
+
+#include "goxx/chan_stats.ipp"
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "goxx/chan_stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace goxx {
+
+inline size_t Histogram::bucket(uint64_t v) {
+    if (v < sub_count)
+        return v;
+    size_t e = 63 - __builtin_clzll(v);
+    auto sub = (v >> (e - sub_bits)) - sub_count;
+    return (e - sub_bits + 1) * sub_count + sub;
+}
+
+inline uint64_t Histogram::bucket_low(size_t idx) {
+    if (idx < sub_count)
+        return idx;
+    auto e = idx / sub_count + sub_bits - 1;
+    auto sub = idx % sub_count;
+    return (uint64_t)(sub_count + sub) << (e - sub_bits);
+}
+
+inline uint64_t Histogram::bucket_high(size_t idx) {
+    if (idx + 1 >= bucket_count)
+        return ~uint64_t{0};
+    return bucket_low(idx + 1) - 1;
+}
+
+inline void Histogram::record(uint64_t v, uint64_t n) {
+    counts_[bucket(v)] += n;
+    count_ += n;
+}
+
+inline void Histogram::merge(const Histogram &other) {
+    for (size_t i = 0; i < bucket_count; i++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+}
+
+inline uint64_t Histogram::percentile(double p) const {
+    if (count_ == 0)
+        return 0;
+    auto rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p / 100 * count_));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        seen += counts_[i];
+        if (seen >= rank)
+            return bucket_high(i);
+    }
+    return max();
+}
+
+inline uint64_t Histogram::max() const {
+    for (size_t i = bucket_count; i-- > 0;) {
+        if (counts_[i])
+            return bucket_high(i);
+    }
+    return 0;
+}
+
+namespace internal {
+
+inline uint64_t ChanCounters::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline ChanCounters::Shard &ChanCounters::shard() {
+    static std::atomic<size_t> next{0};
+    static thread_local const size_t idx =
+        next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+    return shards_[idx];
+}
+
+inline void ChanCounters::try_push_failed() {
+    shard().try_push_failed.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void ChanCounters::try_pop_failed() {
+    shard().try_pop_failed.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void ChanCounters::push_blocked(uint64_t since) {
+    shard().push_blocked.fetch_add(now() - since, std::memory_order_relaxed);
+}
+
+inline void ChanCounters::pop_blocked(uint64_t since) {
+    shard().pop_blocked.fetch_add(now() - since, std::memory_order_relaxed);
+}
+
+inline void ChanCounters::occupancy(size_t n) {
+    auto high = high_water_.load(std::memory_order_relaxed);
+    while (n > high && !high_water_.compare_exchange_weak(
+                           high, n, std::memory_order_relaxed)) {
+    }
+}
+
+inline void ChanCounters::latency(uint64_t since) {
+    auto t = now();
+    latency_[Histogram::bucket(t > since ? t - since : 0)].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+inline void ChanCounters::fill(ChanStats &s) const {
+    for (auto &sh : shards_) {
+        s.try_push_failed += sh.try_push_failed.load(std::memory_order_relaxed);
+        s.try_pop_failed += sh.try_pop_failed.load(std::memory_order_relaxed);
+        s.push_blocked += std::chrono::nanoseconds(
+            sh.push_blocked.load(std::memory_order_relaxed));
+        s.pop_blocked += std::chrono::nanoseconds(
+            sh.pop_blocked.load(std::memory_order_relaxed));
+    }
+    s.high_water = high_water_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < Histogram::bucket_count; i++) {
+        if (auto n = latency_[i].load(std::memory_order_relaxed); n > 0) {
+            s.latency.record(Histogram::bucket_low(i), n);
+        }
+    }
+}
+
+inline ChanRegistry &ChanRegistry::instance() {
+    static ChanRegistry r;
+    return r;
+}
+
+inline size_t ChanRegistry::add(std::function<ChanStats()> snapshot) {
+    auto lg = std::lock_guard{mtx_};
+    chans_.emplace_back(next_id_, std::move(snapshot));
+    return next_id_++;
+}
+
+// waits for a running snapshot, so the chan can go right after
+inline void ChanRegistry::remove(size_t id) {
+    auto lg = std::lock_guard{mtx_};
+    auto it = std::find_if(chans_.begin(), chans_.end(),
+                           [id](auto &c) { return c.first == id; });
+    if (it != chans_.end())
+        chans_.erase(it);
+}
+
+inline std::vector<ChanStats> ChanRegistry::snapshot() {
+    auto lg = std::lock_guard{mtx_};
+    std::vector<ChanStats> res;
+    for (auto &c : chans_) {
+        res.push_back(c.second());
+    }
+    return res;
+}
+
+} // namespace internal
+
+inline std::vector<ChanStats> chan_stats() {
+    return internal::ChanRegistry::instance().snapshot();
+}
+
+inline void dump_chan_stats(std::FILE *out) {
+    for (auto &s : chan_stats()) {
+        // stdio, not fmt: every Chan user includes this
+        using ull = unsigned long long;
+        std::fprintf(
+            out,
+            "chan %-16s cap %6zu len %6zu high %6zu push %10llu pop %10llu "
+            "try fail %llu/%llu blocked %.3f/%.3f ms latency p50 %llu p99 "
+            "%llu max %llu ns (%llu samples)\n",
+            s.name.empty() ? "-" : s.name.c_str(), s.capacity, s.occupancy,
+            s.high_water, (ull)s.pushes, (ull)s.pops, (ull)s.try_push_failed,
+            (ull)s.try_pop_failed, s.push_blocked.count() / 1e6,
+            s.pop_blocked.count() / 1e6, (ull)s.latency.percentile(50),
+            (ull)s.latency.percentile(99), (ull)s.latency.max(),
+            (ull)s.latency.count());
+    }
+}
+
+} // namespace goxx
@@ -0,0 +1,62 @@
+#pragma once
+#include "goxx/chan.hpp"
+#include "goxx/select.hpp"
+#include "goxx/wait_group.hpp"
+#include <optional>
+
+// coroutines need C++20, the rest of goxx stays usable from C++17
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+
+namespace goxx {
+
+namespace internal {
+template <class T>
+class RecvAwaiter;
+template <class T>
+class SendAwaiter;
+struct WaitGroupAwaiter;
+struct Reschedule;
+} // namespace internal
+
+/*
+    a function returning Go is a goroutine: calling it schedules it on the
+    Executor and returns at once. inside, co_await on async_pop, async_push
+    or async_wait suspends the coroutine instead of blocking a thread, it is
+    resumed on the Executor once the chan or wait group is ready. an
+    exception escaping a goroutine terminates, like one escaping go()
+
+        Go stage(Chan<int> &in, Chan<int> &out) {
+            while (auto v = co_await async_pop(in))
+                co_await async_push(out, *v * 2);
+            out.close();
+        }
+ */
+struct Go {
+    struct promise_type {
+        Go get_return_object() noexcept { return {}; }
+        internal::Reschedule initial_suspend() noexcept;
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+// awaits std::optional<T>, empty once ch is closed and drained
+template <class T>
+auto async_pop(Chan<T> &ch) -> internal::RecvAwaiter<T>;
+
+// awaits bool, false if ch is closed
+template <class T>
+auto async_push(Chan<T> &ch, T value) -> internal::SendAwaiter<T>;
+
+// resumes once the count of wg drops to 0
+auto async_wait(WaitGroup &wg) -> internal::WaitGroupAwaiter;
+
+// lets the other goroutines run, resumes on the Executor
+auto reschedule() -> internal::Reschedule;
+
+} // namespace goxx
+
+#include "goxx/co.ipp"
+#endif
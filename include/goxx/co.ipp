@@ -0,0 +1,142 @@
+#pragma once
+#include "goxx/co.hpp"
+#include <atomic>
+#include <utility>
+
+namespace goxx {
+namespace internal {
+
+// handler of the select cases behind the awaiters, the awaiter reads the
+// outcome from the case itself
+struct Ignore {
+    template <class... Args>
+    void operator()(Args &&...) const {}
+};
+
+/*
+    one select case driven by a coroutine, the same protocol as select: poll,
+    attach, poll again, then park. a signal runs step() on the Executor, the
+    coroutine only resumes once the case fired
+ */
+template <class Case>
+class ChanAwaiter {
+  public:
+    template <class... Args>
+    explicit ChanAwaiter(Args &&...args) : case_{std::forward<Args>(args)...} {}
+
+    bool await_ready() { return case_.poll(); }
+    bool await_suspend(std::coroutine_handle<> h) {
+        h_ = h;
+        return !step();
+    }
+
+  protected:
+    Case case_;
+
+  private:
+    bool step(); // true once the case fired, false when parked
+    void detach();
+    static void resume(void *self);
+
+    Selector selector_;
+    std::atomic<bool> claim_{false};
+    bool attached_ = false;
+    std::coroutine_handle<> h_;
+};
+
+template <class Case>
+bool ChanAwaiter<Case>::step() {
+    for (;;) {
+        if (attached_ && claim_.exchange(true)) {
+            // a counterpart completed the rendezvous
+            detach();
+            claim_.store(false);
+            if (case_.handed_off())
+                return true;
+        }
+        if (case_.poll()) {
+            detach();
+            return true;
+        }
+        if (!attached_) {
+            case_.attach(&selector_, &claim_);
+            attached_ = true;
+            continue;
+        }
+        claim_.store(false);
+        // once parked another thread may resume us, hands off this
+        if (selector_.park(&ChanAwaiter::resume, this))
+            return false;
+    }
+}
+
+template <class Case>
+void ChanAwaiter<Case>::detach() {
+    if (!attached_)
+        return;
+    attached_ = false;
+    case_.detach(&selector_);
+}
+
+template <class Case>
+void ChanAwaiter<Case>::resume(void *self) {
+    auto aw = static_cast<ChanAwaiter *>(self);
+    if (aw->step())
+        aw->h_.resume();
+}
+
+template <class T>
+class RecvAwaiter : public ChanAwaiter<RecvCase<T, Ignore>> {
+  public:
+    using ChanAwaiter<RecvCase<T, Ignore>>::ChanAwaiter;
+    std::optional<T> await_resume() { return std::move(this->case_.value); }
+};
+
+template <class T>
+class SendAwaiter : public ChanAwaiter<SendCase<T, Ignore>> {
+  public:
+    using ChanAwaiter<SendCase<T, Ignore>>::ChanAwaiter;
+    bool await_resume() { return this->case_.sent; }
+};
+
+struct WaitGroupAwaiter {
+    WaitGroup *wg;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) {
+        return wg->on_done([h]() { h.resume(); });
+    }
+    void await_resume() const noexcept {}
+};
+
+struct Reschedule {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        Executor::instance().submit([h]() { h.resume(); });
+    }
+    void await_resume() const noexcept {}
+};
+
+} // namespace internal
+
+inline internal::Reschedule Go::promise_type::initial_suspend() noexcept {
+    return {};
+}
+
+template <class T>
+auto async_pop(Chan<T> &ch) -> internal::RecvAwaiter<T> {
+    return internal::RecvAwaiter<T>{&ch, internal::Ignore{}};
+}
+
+template <class T>
+auto async_push(Chan<T> &ch, T value) -> internal::SendAwaiter<T> {
+    return internal::SendAwaiter<T>{&ch, std::move(value), internal::Ignore{}};
+}
+
+inline auto async_wait(WaitGroup &wg) -> internal::WaitGroupAwaiter {
+    return {&wg};
+}
+
+inline auto reschedule() -> internal::Reschedule { return {}; }
+
+} // namespace goxx
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+namespace goxx {
+
+template <class T>
+class Chan;
+
+enum class ContextError {
+    none,
+    cancelled,
+    deadline_exceeded,
+};
+
+namespace internal {
+struct ContextState;
+class CancelHook;
+} // namespace internal
+
+/*
+    go style context: cancel / deadline, passed down to the work it bounds
+
+        auto ctx = Context{}.with_timeout(2s);
+        while (auto job = jobs.pop(ctx)) { }   // nullopt once closed or late
+        mt_sort(v.begin(), v.end(), std::less<>{}, ctx);
+
+    a Context is a cheap handle, copies share one state. cancelling one
+    cancels every context derived from it, never its parent. a default
+    constructed Context is never cancelled and holds no state.
+
+    cancelled() is one relaxed load, fine on a hot path. the waits that take
+    a context (Chan::push / pop, WaitGroup::wait) register an
+    internal::CancelHook on their slow path only, cancel() runs the hooks
+    and the waiters return at once.
+ */
+class Context {
+  public:
+    Context() = default;
+
+    using Clock = std::chrono::steady_clock; // TimerClock
+
+    Context with_cancel() const;
+    // the earlier of d and the deadline of this context
+    Context with_deadline(Clock::time_point d) const;
+    Context with_timeout(Clock::duration d) const;
+
+    void cancel() const; // no-op on a default constructed one
+
+    bool cancelled() const;
+    ContextError err() const;
+    // Clock::time_point::max() without deadline
+    Clock::time_point deadline() const;
+    // closed once cancelled, for select
+    Chan<char> &done() const;
+
+  private:
+    friend class internal::CancelHook;
+    Context derive(Clock::time_point d) const;
+
+    std::shared_ptr<internal::ContextState> s_;
+};
+
+namespace internal {
+/*
+    f() once ctx is cancelled, on the cancelling thread with the context
+    locked, or right away if it is already. lives on the stack of a waiter,
+    unregistering waits for a running f. f must not touch ctx.
+ */
+class CancelHook {
+  public:
+    CancelHook(const Context &ctx, std::function<void()> f);
+    ~CancelHook();
+    CancelHook(const CancelHook &) = delete;
+    CancelHook &operator=(const CancelHook &) = delete;
+
+  private:
+    friend struct ContextState;
+    ContextState *s_ = nullptr;
+    std::function<void()> f_;
+    CancelHook *prev_ = nullptr;
+    CancelHook *next_ = nullptr;
+};
+} // namespace internal
+
+} // namespace goxx
+
+#include "goxx/context.ipp"
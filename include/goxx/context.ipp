@@ -0,0 +1,160 @@
+#pragma once
+
+#include "goxx/chan.hpp"
+#include "goxx/context.hpp"
+#include "goxx/timer.hpp"
+#include <algorithm>
+#include <mutex>
+#include <optional>
+
+namespace goxx {
+
+namespace internal {
+/*
+    locks nest from the timer wheel to parent to child: a deadline is
+    cancelled on the wheel thread, a cancel runs the hooks of its children
+    with its own mtx held. the parent hook goes first on destruction, a
+    cancel of the parent can not reach a half destroyed child. the
+    destructor takes the timer out of the wheel before anything else,
+    which waits for one firing
+ */
+struct ContextState {
+    ~ContextState();
+
+    std::atomic<int> err{0}; // ContextError
+    std::mutex mtx;
+    CancelHook *hooks = nullptr;
+    Context::Clock::time_point deadline = Context::Clock::time_point::max();
+    std::shared_ptr<ContextState> parent;
+    // own deadline, earlier than the parent's. not a Timer, the Executor
+    // may be busy with the very work the deadline is there to stop
+    std::unique_ptr<TimerNode> timer;
+    std::unique_ptr<Chan<char>> done;
+    std::optional<CancelHook> parent_hook; // cancels this with the parent
+
+    void cancel(ContextError e);
+};
+
+inline ContextState::~ContextState() {
+    if (timer)
+        TimerWheel::instance().remove(timer.get());
+}
+
+inline void ContextState::cancel(ContextError e) {
+    auto lg = std::lock_guard{mtx};
+    if (err.load(std::memory_order_relaxed) != 0)
+        return;
+    err.store((int)e, std::memory_order_release);
+    if (done)
+        done->close();
+    for (auto *h = hooks; h; h = h->next_) {
+        h->f_();
+    }
+}
+
+inline CancelHook::CancelHook(const Context &ctx, std::function<void()> f)
+    : f_(std::move(f)) {
+    auto *s = ctx.s_.get();
+    if (!s)
+        return;
+    auto lg = std::lock_guard{s->mtx};
+    if (s->err.load(std::memory_order_relaxed) != 0) {
+        f_();
+        return;
+    }
+    s_ = s;
+    next_ = s->hooks;
+    if (next_)
+        next_->prev_ = this;
+    s->hooks = this;
+}
+
+inline CancelHook::~CancelHook() {
+    if (!s_)
+        return;
+    auto lg = std::lock_guard{s_->mtx};
+    if (prev_) {
+        prev_->next_ = next_;
+    } else {
+        s_->hooks = next_;
+    }
+    if (next_)
+        next_->prev_ = prev_;
+}
+} // namespace internal
+
+inline Context Context::derive(Clock::time_point d) const {
+    Context c;
+    c.s_ = std::make_shared<internal::ContextState>();
+    auto *s = c.s_.get();
+    auto inherited = deadline();
+    s->deadline = std::min(d, inherited);
+    if (s_) {
+        s->parent = s_;
+        s->parent_hook.emplace(*this, [s]() {
+            s->cancel((ContextError)s->parent->err.load(
+                std::memory_order_relaxed));
+        });
+    }
+    if (d < inherited && !s->err.load(std::memory_order_relaxed)) {
+        if (d <= Clock::now()) {
+            s->cancel(ContextError::deadline_exceeded);
+        } else {
+            s->timer = std::make_unique<internal::TimerNode>();
+            s->timer->fire = [s](TimerClock::time_point) {
+                s->cancel(ContextError::deadline_exceeded);
+            };
+            internal::TimerWheel::instance().add(s->timer.get(), d);
+        }
+    }
+    return c;
+}
+
+inline Context Context::with_cancel() const {
+    return derive(Clock::time_point::max());
+}
+
+inline Context Context::with_deadline(Clock::time_point d) const {
+    return derive(d);
+}
+
+inline Context Context::with_timeout(Clock::duration d) const {
+    return derive(Clock::now() + d);
+}
+
+inline void Context::cancel() const {
+    if (s_)
+        s_->cancel(ContextError::cancelled);
+}
+
+inline bool Context::cancelled() const {
+    return s_ && s_->err.load(std::memory_order_relaxed) != 0;
+}
+
+inline ContextError Context::err() const {
+    if (!s_)
+        return ContextError::none;
+    return (ContextError)s_->err.load(std::memory_order_acquire);
+}
+
+inline Context::Clock::time_point Context::deadline() const {
+    if (!s_)
+        return Clock::time_point::max();
+    return s_->deadline;
+}
+
+inline Chan<char> &Context::done() const {
+    if (!s_) {
+        static Chan<char> never{0};
+        return never;
+    }
+    auto lg = std::lock_guard{s_->mtx};
+    if (!s_->done) {
+        s_->done = std::make_unique<Chan<char>>(0);
+        if (s_->err.load(std::memory_order_relaxed))
+            s_->done->close();
+    }
+    return *s_->done;
+}
+
+} // namespace goxx
@@ -1,20 +1,24 @@
 #pragma once
 #include "goxx/annoymous.hpp"
-#include <functional>
 
 namespace goxx {
 
+// runs f when the scope ends, F is deduced so nothing is type erased
+template <class F>
 class Defer {
   public:
-    Defer(std::function<void()> f);
+    Defer(F f);
     ~Defer();
 
+    Defer(const Defer &) = delete;
+    Defer &operator=(const Defer &) = delete;
+
   private:
-    std::function<void()> f_;
+    F f_;
 };
 
 } // namespace goxx
 
-#define goxx_defer(f) Defer goxx_annoy{f};
+#define goxx_defer(...) Defer goxx_annoy{__VA_ARGS__};
 
-#include "goxx/defer.ipp"
\ No newline at end of file
+#include "goxx/defer.ipp"
@@ -1,9 +1,15 @@
 #pragma once
 #include "goxx/defer.hpp"
+#include <utility>
 
 namespace goxx {
 
-Defer::Defer(std::function<void()> f) : f_{f} {}
-Defer::~Defer() { f_(); }
+template <class F>
+Defer<F>::Defer(F f) : f_{std::move(f)} {}
 
-} // namespace goxx
\ No newline at end of file
+template <class F>
+Defer<F>::~Defer() {
+    f_();
+}
+
+} // namespace goxx
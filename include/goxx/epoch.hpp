@@ -0,0 +1,57 @@
+#pragma once
+#include "goxx/padded.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace goxx {
+namespace internal {
+/*
+    epoch based reclamation for read mostly shared state.
+
+    a reader pins the current epoch with a Guard, then loads and uses shared
+    pointers without locks. a writer swaps a pointer and retires the old
+    object, it is freed once every reader that might still see it has left.
+    readers only write their own cache line.
+ */
+class Epoch {
+  public:
+    static Epoch &instance();
+
+    class Guard {
+      public:
+        Guard();
+        ~Guard();
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+    };
+
+    // free runs once no reader pinned before this call is left
+    void retire(std::function<void()> &&free);
+
+  private:
+    struct alignas(cache_line_size) Reader {
+        std::atomic<uint64_t> epoch{0}; // 0 while not pinned
+        std::atomic<bool> taken{true};
+        size_t depth = 0; // owner thread only
+        Reader *next = nullptr;
+    };
+
+    Epoch() = default;
+    Reader *reader();
+    // under mtx_, takes out what no reader can see anymore
+    std::vector<std::function<void()>> collect();
+
+    alignas(cache_line_size) std::atomic<uint64_t> global_{1};
+    std::atomic<Reader *> readers_{nullptr};
+    std::mutex mtx_;
+    std::vector<std::pair<uint64_t, std::function<void()>>> retired_;
+};
+
+} // namespace internal
+} // namespace goxx
+
+#include "goxx/epoch.ipp"
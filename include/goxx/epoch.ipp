@@ -0,0 +1,99 @@
+#pragma once
+#include "goxx/epoch.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace goxx {
+namespace internal {
+
+inline Epoch &Epoch::instance() {
+    // never destroyed, threads may still unpin during exit
+    static auto *epoch = new Epoch;
+    return *epoch;
+}
+
+// reader records are never freed, a thread that exits hands its on
+inline Epoch::Reader *Epoch::reader() {
+    struct Local {
+        Reader *r = nullptr;
+        ~Local() {
+            if (r)
+                r->taken.store(false, std::memory_order_release);
+        }
+    };
+    thread_local Local local;
+    if (local.r)
+        return local.r;
+    for (auto r = readers_.load(std::memory_order_acquire); r; r = r->next) {
+        auto taken = false;
+        if (!r->taken.load(std::memory_order_relaxed) &&
+            r->taken.compare_exchange_strong(taken, true,
+                                             std::memory_order_acquire)) {
+            return local.r = r;
+        }
+    }
+    auto r = new Reader;
+    r->next = readers_.load(std::memory_order_relaxed);
+    while (!readers_.compare_exchange_weak(r->next, r,
+                                           std::memory_order_release)) {
+    }
+    return local.r = r;
+}
+
+/*
+    the pinned epoch is published before the shared pointer is read, retire
+    swaps the pointer before it scans the readers. one of the two sees the
+    other, so a reader that is missed also missed the old object
+ */
+inline Epoch::Guard::Guard() {
+    auto &e = Epoch::instance();
+    auto r = e.reader();
+    if (r->depth++ == 0) {
+        // store then fence, pairs with the fence in collect(). an exchange
+        // alone orders the later loads on x86 only
+        r->epoch.store(e.global_.load(std::memory_order_seq_cst),
+                       std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+inline Epoch::Guard::~Guard() {
+    auto r = Epoch::instance().reader();
+    if (--r->depth == 0)
+        r->epoch.store(0, std::memory_order_release);
+}
+
+inline void Epoch::retire(std::function<void()> &&free) {
+    std::vector<std::function<void()>> frees;
+    {
+        auto lg = std::lock_guard{mtx_};
+        retired_.emplace_back(global_.fetch_add(1, std::memory_order_seq_cst),
+                              std::move(free));
+        frees = collect();
+    }
+    // outside mtx_, a free may retire again
+    for (auto &f : frees) {
+        f();
+    }
+}
+
+inline auto Epoch::collect() -> std::vector<std::function<void()>> {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto oldest = std::numeric_limits<uint64_t>::max();
+    for (auto r = readers_.load(std::memory_order_acquire); r; r = r->next) {
+        if (auto e = r->epoch.load(std::memory_order_acquire); e != 0)
+            oldest = std::min(oldest, e);
+    }
+    // retired at epoch e: readers pinned at e or before may hold it
+    auto keep = std::partition(retired_.begin(), retired_.end(),
+                               [&](auto &r) { return r.first >= oldest; });
+    std::vector<std::function<void()>> frees;
+    for (auto it = keep; it != retired_.end(); it++) {
+        frees.push_back(std::move(it->second));
+    }
+    retired_.erase(keep, retired_.end());
+    return frees;
+}
+
+} // namespace internal
+} // namespace goxx
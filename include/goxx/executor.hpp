@@ -0,0 +1,83 @@
+#pragma once
+
+#include "goxx/padded.hpp"
+#include "goxx/task.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace goxx {
+
+// where WaitGroup::go / together run a task
+enum class Launch {
+    pool,      // the process wide Executor
+    dedicated, // a new detached thread, for tasks that block for long
+};
+
+/*
+    process wide work stealing executor
+
+    hardware_concurrency workers, each with its own deque. a worker pushes
+    and pops at the back of its deque, idle workers steal from the front of
+    the others, tasks from outside the pool go to a shared queue.
+    started on first use, drained at exit: the tasks queued and running
+    are done, idle threads exit and are waited for. a thread blocked in a
+    chan, select or wait group wait is left detached, it could wait for
+    ever, the pool is never freed for its sake. a task blocked outside
+    goxx, sleeping or on its own mutex, holds exit until it returns.
+
+    a pool thread about to block (chan, select, wait group) says so with a
+    Blocking guard, the pool then starts spare threads so that hardware
+    concurrency threads stay runnable and queued tasks still make progress.
+ */
+class Executor {
+  public:
+    static Executor &instance();
+
+    void submit(Task &&f);
+    size_t size() const; // regular workers
+
+    class Blocking {
+      public:
+        Blocking();
+        ~Blocking();
+
+      private:
+        Executor *ex_;
+    };
+
+  private:
+    explicit Executor(size_t n);
+
+    struct alignas(cache_line_size) Worker {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    bool take(size_t self, Task &task);
+    void run_worker(size_t idx);
+    void run_spare();
+    void shutdown(); // at exit
+    void block();
+    void unblock();
+
+    const size_t n_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    Worker global_;
+    alignas(cache_line_size) std::atomic<size_t> pending_{0};
+    alignas(cache_line_size) std::atomic<size_t> idle_{0};
+    std::atomic<size_t> blocked_{0};
+    std::atomic<size_t> spares_{0};
+    std::atomic<size_t> live_; // regular workers not exited
+    std::atomic<bool> stopping_{false};
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+} // namespace goxx
+
+#include "goxx/executor.ipp"
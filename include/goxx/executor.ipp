@@ -0,0 +1,198 @@
+#pragma once
+
+#include "goxx/executor.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace goxx {
+
+namespace internal {
+// set on pool threads only
+inline thread_local Executor *current_executor = nullptr;
+inline thread_local size_t current_worker = ~size_t{0};
+inline thread_local size_t blocking_depth = 0;
+} // namespace internal
+
+// never freed, threads left blocked at exit still use it. drained at exit
+inline Executor &Executor::instance() {
+    static auto *ex =
+        new Executor{std::max(1u, std::thread::hardware_concurrency())};
+    static struct Drain {
+        Executor *ex;
+        ~Drain() { ex->shutdown(); }
+    } drain{ex};
+    return *ex;
+}
+
+inline Executor::Executor(size_t n) : n_(n), live_(n) {
+    for (size_t i = 0; i < n_; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < n_; i++) {
+        std::thread([this, i]() { run_worker(i); }).detach();
+    }
+}
+
+inline size_t Executor::size() const { return n_; }
+
+/*
+    idle threads run what is queued, then exit. a thread blocked in a goxx
+    wait is not waited for: it may wait on a chan nobody closes. block()
+    notifies, a thread blocking can be the last one missing
+ */
+inline void Executor::shutdown() {
+    // exit() from a task, its own thread never gets out
+    size_t self = internal::current_executor == this ? 1 : 0;
+    auto ul = std::unique_lock{mtx_};
+    stopping_.store(true, std::memory_order_seq_cst);
+    cv_.notify_all();
+    cv_.wait(ul, [&]() {
+        return live_.load() + spares_.load() <= blocked_.load() + self;
+    });
+}
+
+inline void Executor::submit(Task &&f) {
+    auto &w = internal::current_executor == this &&
+                      internal::current_worker < n_
+                  ? *workers_[internal::current_worker]
+                  : global_;
+    {
+        // counted before the task can be seen, the pop that takes it
+        // holds the same lock and never gets pending_ below zero
+        auto lg = std::lock_guard{w.mtx};
+        pending_.fetch_add(1, std::memory_order_seq_cst);
+        w.tasks.push_back(std::move(f));
+    }
+    // pairs with the idle_ / pending_ check of a parking thread
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_.load(std::memory_order_relaxed) > 0) {
+        auto lg = std::lock_guard{mtx_};
+        cv_.notify_one();
+    }
+}
+
+/*
+    own deque from the back, then the shared queue, then steal from the
+    front of the other workers
+ */
+inline bool Executor::take(size_t self, Task &task) {
+    if (pending_.load(std::memory_order_acquire) == 0)
+        return false;
+    auto pop = [&](Worker &w, bool back) {
+        auto lg = std::lock_guard{w.mtx};
+        if (w.tasks.empty())
+            return false;
+        if (back) {
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+        } else {
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+        }
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    };
+    if (self < n_ && pop(*workers_[self], true))
+        return true;
+    if (pop(global_, false))
+        return true;
+    auto start = self < n_ ? self : (size_t)std::hash<std::thread::id>{}(
+                                        std::this_thread::get_id());
+    for (size_t i = 1; i <= n_; i++) {
+        auto victim = (start + i) % n_;
+        if (victim != self && pop(*workers_[victim], false))
+            return true;
+    }
+    return false;
+}
+
+inline void Executor::run_worker(size_t idx) {
+    internal::current_executor = this;
+    internal::current_worker = idx;
+    Task task;
+    for (;;) {
+        if (take(idx, task)) {
+            task();
+            task = Task{};
+            continue;
+        }
+        auto ul = std::unique_lock{mtx_};
+        idle_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv_.wait(ul, [this]() {
+            return pending_.load(std::memory_order_relaxed) > 0 ||
+                   stopping_.load(std::memory_order_relaxed);
+        });
+        idle_.fetch_sub(1, std::memory_order_relaxed);
+        if (stopping_.load() && pending_.load() == 0) {
+            live_.fetch_sub(1);
+            // under mtx_, shutdown() may be waiting for us
+            cv_.notify_all();
+            return;
+        }
+    }
+}
+
+/*
+    a spare only steals. it retires after idling for a while once there are
+    more spares than blocked threads
+ */
+inline void Executor::run_spare() {
+    internal::current_executor = this;
+    Task task;
+    for (;;) {
+        if (take(~size_t{0}, task)) {
+            task();
+            task = Task{};
+            continue;
+        }
+        auto ul = std::unique_lock{mtx_};
+        idle_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto woken = cv_.wait_for(ul, std::chrono::seconds(1), [this]() {
+            return pending_.load(std::memory_order_relaxed) > 0 ||
+                   stopping_.load(std::memory_order_relaxed);
+        });
+        idle_.fetch_sub(1, std::memory_order_relaxed);
+        if (stopping_.load() && pending_.load() == 0) {
+            spares_.fetch_sub(1);
+            cv_.notify_all();
+            return;
+        }
+        if (woken)
+            continue;
+        auto spares = spares_.load();
+        if (spares > blocked_.load() &&
+            spares_.compare_exchange_strong(spares, spares - 1))
+            return;
+    }
+}
+
+inline void Executor::block() {
+    auto blocked = blocked_.fetch_add(1) + 1;
+    if (stopping_.load()) {
+        auto lg = std::lock_guard{mtx_};
+        cv_.notify_all();
+    }
+    auto spares = spares_.load();
+    while (spares < blocked) {
+        if (spares_.compare_exchange_weak(spares, spares + 1)) {
+            std::thread([this]() { run_spare(); }).detach();
+            break;
+        }
+    }
+}
+
+inline void Executor::unblock() { blocked_.fetch_sub(1); }
+
+inline Executor::Blocking::Blocking() : ex_(internal::current_executor) {
+    if (ex_ && internal::blocking_depth++ == 0)
+        ex_->block();
+}
+
+inline Executor::Blocking::~Blocking() {
+    if (ex_ && --internal::blocking_depth == 0)
+        ex_->unblock();
+}
+
+} // namespace goxx
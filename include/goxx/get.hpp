@@ -7,6 +7,42 @@ struct GetOption {
     bool permanent = false;
 };
 
+namespace internal {
+template <class T>
+class Slot;
+} // namespace internal
+
+template <class T>
+class Handle;
+
+template <class Dependency, class Storagetype = Dependency>
+auto handle(const GetOption &option = GetOption{}) -> Handle<Storagetype>;
+
+/*
+    a get() resolved once: the tag is hashed and looked up when the handle is
+    made, get() on the handle only reads the slot, without locks. same
+    weak / permanent semantics as goxx::get with the same option
+ */
+template <class T>
+class Handle {
+  public:
+    Handle() = default;
+
+    std::shared_ptr<T> get() const;
+
+    template <class Creator>
+    std::shared_ptr<T> get(Creator &&creator) const;
+
+    explicit operator bool() const { return slot_ != nullptr; }
+
+  private:
+    template <class Dependency, class Storagetype>
+    friend auto handle(const GetOption &option) -> Handle<Storagetype>;
+
+    internal::Slot<T> *slot_ = nullptr;
+    bool permanent_ = false;
+};
+
 template <class Dependency, class Creator, class Storagetype = Dependency>
 auto get(Creator &&creator, const GetOption &option = GetOption{})
     -> std::shared_ptr<Storagetype>;
@@ -15,4 +51,4 @@ template <class Dependency, class Storagetype = Dependency>
 auto get(const GetOption &option = GetOption{}) -> std::shared_ptr<Storagetype>;
 
 } // namespace goxx
-#include "goxx/get.ipp"
\ No newline at end of file
+#include "goxx/get.ipp"
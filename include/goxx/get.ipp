@@ -1,87 +1,170 @@
 #pragma once
+#include "goxx/epoch.hpp"
+#include <atomic>
 #include <memory>
-#include <shared_mutex>
-#include <typeindex>
+#include <mutex>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 namespace goxx {
 
 namespace internal {
 
-template <class Dependency>
-auto get(std::function<std::shared_ptr<Dependency>()> &&creator,
-         const GetOption &option) -> std::shared_ptr<Dependency> {
-
-    static std::unordered_map<std::string, std::weak_ptr<Dependency>>
-        referrences;
-    static std::unordered_map<std::string, std::shared_ptr<Dependency>>
-        permanent_referrences;
-    static std::shared_mutex mtx;
-
+/*
+    one tag of one type. readers load the current entry under an epoch
+    guard, writers replace it under mtx_ and retire the old one. once
+    permanent an entry never changes
+ */
+template <class T>
+class Slot {
+  public:
+    ~Slot() { delete entry_.load(); }
+
+    template <class Creator>
+    std::shared_ptr<T> get(Creator &&creator, bool permanent);
+
+  private:
+    struct Entry {
+        bool permanent;
+        std::shared_ptr<T> strong; // permanent only
+        std::weak_ptr<T> weak;
+    };
+
+    std::atomic<const Entry *> entry_{nullptr};
+    std::mutex mtx_;
+};
+
+template <class T>
+template <class Creator>
+std::shared_ptr<T> Slot<T>::get(Creator &&creator, bool permanent) {
     {
-        auto sl = std::shared_lock{mtx};
-
-        if (auto itr = permanent_referrences.find(option.tag);
-            itr != permanent_referrences.end()) {
-            return itr->second;
-        }
-
-        if (!option.permanent) {
-            if (auto itr = referrences.find(option.tag);
-                itr != referrences.end()) {
-                if (auto sptr = itr->second.lock(); sptr) {
+        Epoch::Guard guard;
+        if (auto e = entry_.load(std::memory_order_acquire); e) {
+            if (e->permanent) {
+                return e->strong;
+            }
+            if (!permanent) {
+                if (auto sptr = e->weak.lock(); sptr) {
                     return sptr;
                 }
             }
         }
     }
 
-    std::shared_ptr<Dependency> sptr;
-
-    auto ul = std::unique_lock{mtx};
-
-    if (auto itr = permanent_referrences.find(option.tag);
-        itr != permanent_referrences.end()) {
-        sptr = itr->second;
+    auto lg = std::lock_guard{mtx_};
+    auto e = entry_.load(std::memory_order_relaxed);
+    if (e && e->permanent) {
+        return e->strong;
     }
-
-    if (!sptr) {
-        if (auto itr = referrences.find(option.tag); itr != referrences.end()) {
-            sptr = itr->second.lock();
-        }
+    std::shared_ptr<T> sptr;
+    if (e) {
+        sptr = e->weak.lock();
+    }
+    if (sptr && !permanent) {
+        return sptr;
     }
-
     if (!sptr) {
         sptr = creator();
     }
+    if (!sptr && !permanent) {
+        // an empty weak entry is the same as none
+        return sptr;
+    }
+    entry_.store(permanent ? new Entry{true, sptr, {}}
+                           : new Entry{false, nullptr, sptr},
+                 std::memory_order_release);
+    if (e) {
+        Epoch::instance().retire([e]() { delete e; });
+    }
+    return sptr;
+}
 
-    if (option.permanent ||
-        permanent_referrences.find(option.tag) != permanent_referrences.end()) {
+/*
+    tag -> slot of one type. the map is an immutable snapshot read under an
+    epoch guard, a new tag copies it. slots live as long as the registry
+ */
+template <class T>
+class Registry {
+  public:
+    static Registry &instance() {
+        static Registry registry;
+        return registry;
+    }
 
-        permanent_referrences[option.tag] = sptr;
-        referrences.erase(option.tag);
+    ~Registry() { delete map_.load(); }
 
-    } else {
-        referrences[option.tag] = std::weak_ptr{sptr};
+    Slot<T> *resolve(const std::string &tag);
+
+  private:
+    using Map = std::unordered_map<std::string, Slot<T> *>;
+
+    Registry() = default;
+
+    std::atomic<const Map *> map_{new Map};
+    std::mutex mtx_;
+    std::vector<std::unique_ptr<Slot<T>>> slots_;
+};
+
+template <class T>
+Slot<T> *Registry<T>::resolve(const std::string &tag) {
+    {
+        Epoch::Guard guard;
+        auto map = map_.load(std::memory_order_acquire);
+        if (auto itr = map->find(tag); itr != map->end()) {
+            return itr->second;
+        }
     }
 
-    return sptr;
+    auto lg = std::lock_guard{mtx_};
+    auto map = map_.load(std::memory_order_relaxed);
+    if (auto itr = map->find(tag); itr != map->end()) {
+        return itr->second;
+    }
+    auto slot = slots_.emplace_back(std::make_unique<Slot<T>>()).get();
+    auto next = new Map(*map);
+    (*next)[tag] = slot;
+    map_.store(next, std::memory_order_release);
+    Epoch::instance().retire([map]() { delete map; });
+    return slot;
 }
 } // namespace internal
 
+template <class T>
+std::shared_ptr<T> Handle<T>::get() const {
+    return slot_->get([]() { return std::shared_ptr<T>{}; }, permanent_);
+}
+
+template <class T>
+template <class Creator>
+std::shared_ptr<T> Handle<T>::get(Creator &&creator) const {
+    return slot_->get(
+        [&creator]() -> std::shared_ptr<T> {
+            return std::shared_ptr<T>{creator()};
+        },
+        permanent_);
+}
+
+template <class Dependency, class Storagetype>
+auto handle(const GetOption &option) -> Handle<Storagetype> {
+    Handle<Storagetype> h;
+    h.slot_ = internal::Registry<Storagetype>::instance().resolve(option.tag);
+    h.permanent_ = option.permanent;
+    return h;
+}
+
+// one guard for both lookups, nested guards do not pin again
 template <class Dependency, class Creator, class Storagetype>
 auto get(Creator &&creator, const GetOption &option)
     -> std::shared_ptr<Storagetype> {
-    return internal::get<Storagetype>(
-        [&creator]() -> std::shared_ptr<Storagetype> {
-            return std::shared_ptr<Storagetype>{creator()};
-        },
-        option);
+    internal::Epoch::Guard guard;
+    return handle<Dependency, Storagetype>(option).get(
+        std::forward<Creator>(creator));
 }
 
 template <class Dependency, class Storagetype>
 auto get(const GetOption &option) -> std::shared_ptr<Storagetype> {
-    return internal::get<Storagetype>(
-        []() { return std::shared_ptr<Storagetype>{}; }, option);
+    internal::Epoch::Guard guard;
+    return handle<Dependency, Storagetype>(option).get();
 }
 
 } // namespace goxx
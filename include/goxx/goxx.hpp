@@ -1,11 +1,27 @@
 #pragma once
 
 #include "goxx/annoymous.hpp"
+#include "goxx/broadcast_chan.hpp"
+#include "goxx/byte_chan.hpp"
 #include "goxx/cases.hpp"
 #include "goxx/chan.hpp"
+#include "goxx/chan_stats.hpp"
+#include "goxx/co.hpp"
+#include "goxx/context.hpp"
 #include "goxx/defer.hpp"
 #include "goxx/elapse.hpp"
+#include "goxx/executor.hpp"
 #include "goxx/get.hpp"
 #include "goxx/init.hpp"
+#include "goxx/msg_pool.hpp"
 #include "goxx/mt_sort.hpp"
+#include "goxx/parallel.hpp"
+#include "goxx/pipeline.hpp"
+#include "goxx/select.hpp"
+#ifdef __linux__
+#include "goxx/shm_chan.hpp"
+#endif
+#include "goxx/spsc_chan.hpp"
+#include "goxx/task.hpp"
+#include "goxx/timer.hpp"
 #include "goxx/wait_group.hpp"
\ No newline at end of file
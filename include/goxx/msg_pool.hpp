@@ -0,0 +1,181 @@
+#pragma once
+
+#include "goxx/padded.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+
+namespace goxx {
+
+namespace internal {
+// lives inside a free item, so a free list never allocates
+struct FreeLink {
+    FreeLink *next = nullptr;
+    FreeLink *next_batch = nullptr; // depot only, first item of a batch
+};
+
+/*
+    free list in per thread shards. a thread frees onto its shard and hands
+    every full batch on to a shared depot at once, a thread out of items
+    takes a whole batch back. a producer allocating on one core and a
+    consumer freeing on another meet once per batch, not once per item.
+    the own frees of a thread come back first, they are still in its cache.
+    a shard is locked by a flag, one exchange: threads only share one past
+    shard_count threads
+ */
+template <class Drop>
+class FreeCache {
+  public:
+    static constexpr size_t shard_count = 32;
+
+    // max_batches in the depot, a batch freed past that is dropped
+    FreeCache(size_t batch, size_t max_batches, Drop drop);
+    ~FreeCache(); // drops everything cached
+    FreeCache(const FreeCache &) = delete;
+    FreeCache &operator=(const FreeCache &) = delete;
+
+    FreeLink *get(); // nullptr when nothing is free
+    void put(FreeLink *l);
+
+  private:
+    struct Shard {
+        std::atomic<bool> busy{false};
+        FreeLink *local = nullptr; // a batch taken from the depot
+        FreeLink *ret = nullptr;   // freed here, less than a batch
+        size_t nret = 0;
+    };
+
+    Shard &shard(); // locked
+    void unlock(Shard &s);
+    void drop_list(FreeLink *l);
+
+    const size_t batch_;
+    const size_t max_batches_;
+    Drop drop_;
+    std::array<Padded<Shard>, shard_count> shards_;
+    std::mutex mtx_;
+    FreeLink *depot_ = nullptr; // batches linked by next_batch
+    size_t batches_ = 0;
+};
+} // namespace internal
+
+/*
+    recycled messages for chans of heavy payloads
+
+        MsgPool<std::vector<int>> pool;
+        Chan<MsgPool<std::vector<int>>::Ptr> c{64};
+        auto m = pool.get();          // producer
+        m->assign(...);
+        c.push(std::move(m));
+        auto m = c.pop();             // consumer, the vector goes back to
+                                      // the pool once m is gone
+
+    a Ptr is one pointer, like a unique_ptr. the T it points to is never
+    destroyed while the pool is up: a T with clear() is cleared when it
+    comes back, any other T is assigned T{}. only contiguous containers,
+    vector and the like, keep their buffer through clear(): a pipeline of
+    those stops allocating once the pool holds what is in flight. node
+    based payloads, map or list, free their nodes on clear() and every
+    string or buffer in them, the pool only saves the T itself. put those
+    in pmr containers on a PoolResource, below.
+
+    the pool outlives its Ptrs, like a memory resource its containers.
+ */
+template <class T>
+class MsgPool {
+    struct Node : internal::FreeLink {
+        MsgPool *pool = nullptr;
+        T value{};
+    };
+
+  public:
+    class Ptr {
+      public:
+        Ptr() = default;
+        Ptr(Ptr &&other) noexcept;
+        Ptr &operator=(Ptr &&other) noexcept;
+        ~Ptr(); // reset()
+
+        T &operator*() const;
+        T *operator->() const;
+        T *get() const;
+        explicit operator bool() const;
+        void reset(); // back to the pool
+
+      private:
+        friend class MsgPool;
+        explicit Ptr(Node *n);
+        Node *n_ = nullptr;
+    };
+
+    // batch: how many values a thread frees before passing them on,
+    // max_cached: values the pool keeps, the ones past that are deleted
+    explicit MsgPool(size_t batch = 64, size_t max_cached = 1 << 16);
+    MsgPool(const MsgPool &) = delete;
+    MsgPool &operator=(const MsgPool &) = delete;
+
+    Ptr get(); // a recycled T if one is free, else a new one
+
+  private:
+    struct Drop {
+        void operator()(internal::FreeLink *l) const;
+    };
+
+    void put(Node *n);
+
+    internal::FreeCache<Drop> cache_;
+};
+
+/*
+    std::pmr::memory_resource on the same sharded free lists, for payloads
+    owning nodes or buffers, map / string / vector:
+
+        PoolResource res;
+        std::pmr::map<std::pmr::string, std::pmr::string> m{&res};
+
+    blocks up to 4KB come in power of two classes from 16 bytes and go back
+    to their class, from whatever thread frees them. bigger or over aligned
+    ones go straight to upstream. thread safe, unlike
+    std::pmr::unsynchronized_pool_resource, and without the lock per call
+    of std::pmr::synchronized_pool_resource.
+ */
+class PoolResource : public std::pmr::memory_resource {
+  public:
+    explicit PoolResource(
+        std::pmr::memory_resource *upstream = std::pmr::get_default_resource(),
+        size_t batch = 64, size_t max_cached_bytes = 64 << 20);
+    ~PoolResource() override; // cached blocks go back upstream
+    PoolResource(const PoolResource &) = delete;
+    PoolResource &operator=(const PoolResource &) = delete;
+
+    std::pmr::memory_resource *upstream() const;
+
+  protected:
+    void *do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void *p, size_t bytes, size_t align) override;
+    bool do_is_equal(
+        const std::pmr::memory_resource &other) const noexcept override;
+
+  private:
+    static constexpr size_t min_block = 16;
+    static constexpr size_t classes = 9; // 16 .. 4096
+    static constexpr size_t max_block = min_block << (classes - 1);
+
+    struct Drop {
+        std::pmr::memory_resource *upstream;
+        size_t size;
+        void operator()(internal::FreeLink *l) const;
+    };
+
+    static size_t class_of(size_t bytes);
+
+    std::pmr::memory_resource *upstream_;
+    std::array<std::unique_ptr<internal::FreeCache<Drop>>, classes> classes_;
+};
+
+} // namespace goxx
+
+#include "goxx/msg_pool.ipp"
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "goxx/defer.hpp"
+#include "goxx/msg_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace goxx {
+
+namespace internal {
+template <class Drop>
+FreeCache<Drop>::FreeCache(size_t batch, size_t max_batches, Drop drop)
+    : batch_(std::max<size_t>(batch, 1)), max_batches_(max_batches),
+      drop_(std::move(drop)) {}
+
+template <class Drop>
+FreeCache<Drop>::~FreeCache() {
+    for (auto &s : shards_) {
+        drop_list(s.value.local);
+        drop_list(s.value.ret);
+    }
+    while (depot_) {
+        auto *next = depot_->next_batch;
+        drop_list(depot_);
+        depot_ = next;
+    }
+}
+
+template <class Drop>
+void FreeCache<Drop>::drop_list(FreeLink *l) {
+    while (l) {
+        auto *next = l->next;
+        drop_(l);
+        l = next;
+    }
+}
+
+template <class Drop>
+typename FreeCache<Drop>::Shard &FreeCache<Drop>::shard() {
+    static std::atomic<size_t> next{0};
+    static thread_local const size_t idx =
+        next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+    auto &s = shards_[idx].value;
+    while (s.busy.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    return s;
+}
+
+template <class Drop>
+void FreeCache<Drop>::unlock(Shard &s) {
+    s.busy.store(false, std::memory_order_release);
+}
+
+template <class Drop>
+FreeLink *FreeCache<Drop>::get() {
+    auto &s = shard();
+    goxx_defer([&]() { unlock(s); });
+    if (s.ret) {
+        auto *l = s.ret;
+        s.ret = l->next;
+        s.nret--;
+        return l;
+    }
+    if (!s.local) {
+        auto depot = std::lock_guard{mtx_};
+        if (!depot_)
+            return nullptr;
+        s.local = depot_;
+        depot_ = depot_->next_batch;
+        batches_--;
+    }
+    auto *l = s.local;
+    s.local = l->next;
+    return l;
+}
+
+template <class Drop>
+void FreeCache<Drop>::put(FreeLink *l) {
+    auto &s = shard();
+    l->next = s.ret;
+    s.ret = l;
+    if (++s.nret < batch_) {
+        unlock(s);
+        return;
+    }
+    auto *full = std::exchange(s.ret, nullptr);
+    s.nret = 0;
+    unlock(s);
+    {
+        auto lg = std::lock_guard{mtx_};
+        if (batches_ < max_batches_) {
+            full->next_batch = depot_;
+            depot_ = full;
+            batches_++;
+            return;
+        }
+    }
+    drop_list(full);
+}
+
+// clear() keeps the buffer of a vector for the next message, not the
+// nodes of a map
+template <class T, class = void>
+struct has_clear : std::false_type {};
+template <class T>
+struct has_clear<T, std::void_t<decltype(std::declval<T &>().clear())>>
+    : std::true_type {};
+} // namespace internal
+
+template <class T>
+MsgPool<T>::Ptr::Ptr(Node *n) : n_(n) {}
+
+template <class T>
+MsgPool<T>::Ptr::Ptr(Ptr &&other) noexcept
+    : n_(std::exchange(other.n_, nullptr)) {}
+
+template <class T>
+typename MsgPool<T>::Ptr &MsgPool<T>::Ptr::operator=(Ptr &&other) noexcept {
+    if (this != &other) {
+        reset();
+        n_ = std::exchange(other.n_, nullptr);
+    }
+    return *this;
+}
+
+template <class T>
+MsgPool<T>::Ptr::~Ptr() {
+    reset();
+}
+
+template <class T>
+T &MsgPool<T>::Ptr::operator*() const {
+    return n_->value;
+}
+
+template <class T>
+T *MsgPool<T>::Ptr::operator->() const {
+    return &n_->value;
+}
+
+template <class T>
+T *MsgPool<T>::Ptr::get() const {
+    return n_ ? &n_->value : nullptr;
+}
+
+template <class T>
+MsgPool<T>::Ptr::operator bool() const {
+    return n_ != nullptr;
+}
+
+template <class T>
+void MsgPool<T>::Ptr::reset() {
+    if (auto *n = std::exchange(n_, nullptr))
+        n->pool->put(n);
+}
+
+template <class T>
+void MsgPool<T>::Drop::operator()(internal::FreeLink *l) const {
+    delete static_cast<Node *>(l);
+}
+
+template <class T>
+MsgPool<T>::MsgPool(size_t batch, size_t max_cached)
+    : cache_(batch, max_cached / std::max<size_t>(batch, 1), Drop{}) {}
+
+template <class T>
+typename MsgPool<T>::Ptr MsgPool<T>::get() {
+    if (auto *l = cache_.get())
+        return Ptr{static_cast<Node *>(l)};
+    auto *n = new Node{};
+    n->pool = this;
+    return Ptr{n};
+}
+
+// recycled on the freeing thread, which has the value in its cache
+template <class T>
+void MsgPool<T>::put(Node *n) {
+    if constexpr (internal::has_clear<T>::value) {
+        n->value.clear();
+    } else {
+        n->value = T{};
+    }
+    cache_.put(n);
+}
+
+inline PoolResource::PoolResource(std::pmr::memory_resource *upstream,
+                                  size_t batch, size_t max_cached_bytes)
+    : upstream_(upstream) {
+    batch = std::max<size_t>(batch, 1);
+    for (size_t c = 0; c < classes; c++) {
+        auto size = min_block << c;
+        auto per_class = max_cached_bytes / classes;
+        classes_[c] = std::make_unique<internal::FreeCache<Drop>>(
+            batch, std::max<size_t>(per_class / (batch * size), 1),
+            Drop{upstream_, size});
+    }
+}
+
+inline PoolResource::~PoolResource() = default;
+
+inline std::pmr::memory_resource *PoolResource::upstream() const {
+    return upstream_;
+}
+
+inline void PoolResource::Drop::operator()(internal::FreeLink *l) const {
+    l->~FreeLink();
+    upstream->deallocate(l, size, alignof(std::max_align_t));
+}
+
+inline size_t PoolResource::class_of(size_t bytes) {
+    if (bytes <= min_block)
+        return 0;
+    // ceil(log2(bytes)) - log2(min_block)
+    return 64 - __builtin_clzll((unsigned long long)bytes - 1) - 4;
+}
+
+inline void *PoolResource::do_allocate(size_t bytes, size_t align) {
+    if (bytes > max_block || align > alignof(std::max_align_t))
+        return upstream_->allocate(bytes, align);
+    auto c = class_of(bytes);
+    if (auto *l = classes_[c]->get()) {
+        l->~FreeLink();
+        return l;
+    }
+    return upstream_->allocate(min_block << c, alignof(std::max_align_t));
+}
+
+inline void PoolResource::do_deallocate(void *p, size_t bytes,
+                                        size_t align) {
+    if (bytes > max_block || align > alignof(std::max_align_t)) {
+        upstream_->deallocate(p, bytes, align);
+        return;
+    }
+    classes_[class_of(bytes)]->put(::new (p) internal::FreeLink{});
+}
+
+inline bool PoolResource::do_is_equal(
+    const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
+
+} // namespace goxx
@@ -1,11 +1,33 @@
 #pragma once
 
+#include "goxx/context.hpp"
+
 namespace goxx {
+// arithmetic values under std::less / std::greater are radix sorted, the
+// rest goes through a parallel sample sort
 template <class Iterator, class Compare>
 void mt_sort(Iterator first, Iterator last, Compare comp);
 
 template <class Iterator>
 void mt_sort(Iterator first, Iterator last);
+
+// sort by key(element). arithmetic keys under std::less / std::greater take
+// the radix path, which is also stable
+template <class Iterator, class Key, class Compare>
+void mt_sort_by_key(Iterator first, Iterator last, Key key, Compare comp);
+
+template <class Iterator, class Key>
+void mt_sort_by_key(Iterator first, Iterator last, Key key);
+
+// false once ctx is cancelled, the range then holds its elements in no
+// particular order. looked at between phases, per bucket and per radix
+// pass, a range small enough for one std::sort only checks before it
+template <class Iterator, class Compare>
+bool mt_sort(Iterator first, Iterator last, Compare comp, const Context &ctx);
+
+template <class Iterator, class Key, class Compare>
+bool mt_sort_by_key(Iterator first, Iterator last, Key key, Compare comp,
+                    const Context &ctx);
 } // namespace goxx
 
 #include "goxx/mt_sort.ipp"
\ No newline at end of file
@@ -1,94 +1,523 @@
 #pragma once
-#include "goxx/chan.hpp"
+#include "goxx/context.hpp"
+#include "goxx/defer.hpp"
+#include "goxx/executor.hpp"
 #include "goxx/wait_group.hpp"
-#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <functional>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <type_traits>
+#include <vector>
 
 namespace goxx {
-template <class Iterator>
-void mt_sort(Iterator first, Iterator last) {
-    mt_sort(first, last, std::less<>{});
-}
 
-template <class Iterator, class Compare>
-void mt_sort(Iterator first, Iterator last, Compare comp) {
-    auto N = std::distance(first, last);
-    if (N <= 1)
-        return;
+namespace internal {
+// below this a single std::sort (introsort) wins
+inline constexpr size_t mt_sort_cutoff = 1 << 15;
+// buckets per worker, more buckets even out skewed splitters
+inline constexpr size_t mt_sort_buckets_per_worker = 4;
+// samples per bucket
+inline constexpr size_t mt_sort_oversample = 32;
+// radix sort pays off from here on
+inline constexpr size_t radix_sort_cutoff = 1 << 11;
+// smallest block one worker counts / scatters
+inline constexpr size_t radix_sort_block = 1 << 14;
 
-    auto first_pivot = true;
+// keys radix sort can order: integers, bool, ieee float and double
+template <class K>
+inline constexpr bool radix_key_type =
+    std::is_integral_v<K> ||
+    (std::is_floating_point_v<K> && std::numeric_limits<K>::is_iec559 &&
+     (sizeof(K) == 4 || sizeof(K) == 8));
 
-    WaitGroup wg{};
-    // Chan<std::pair<Iterator, Iterator>>
-    // ch{std::thread::hardware_concurrency()};
-    auto thread_limit = (1 << 10);
+// 1 for ascending, -1 for descending, 0 when comp is something else
+template <class Compare, class K>
+inline constexpr int radix_order =
+    std::is_same_v<Compare, std::less<>> || std::is_same_v<Compare, std::less<K>>
+        ? 1
+    : std::is_same_v<Compare, std::greater<>> ||
+            std::is_same_v<Compare, std::greater<K>>
+        ? -1
+        : 0;
 
-    std::function<void(Iterator, Iterator)> impl = [&](auto left, auto right) {
-        auto d = std::distance(left, right);
-        if (d <= 0) {
+// unsigned key of the same width, ordered like k
+template <class K>
+auto radix_key(K k) {
+    if constexpr (std::is_same_v<K, bool>) {
+        return (uint8_t)k;
+    } else if constexpr (std::is_integral_v<K>) {
+        using U = std::make_unsigned_t<K>;
+        if constexpr (std::is_signed_v<K>) {
+            return (U)((U)k ^ ((U)1 << (sizeof(U) * 8 - 1)));
+        } else {
+            return (U)k;
+        }
+    } else {
+        // negative floats order reversed, flip all bits, else the sign bit
+        using U = std::conditional_t<sizeof(K) == 4, uint32_t, uint64_t>;
+        U u;
+        std::memcpy(&u, &k, sizeof(u));
+        constexpr auto sign = (U)1 << (sizeof(U) * 8 - 1);
+        return u & sign ? (U)~u : (U)(u | sign);
+    }
+}
+
+/*
+    parallel LSD radix sort, one byte per pass, stable.
+    key(v) gives the unsigned key of an element. each pass counts the digit
+    per block, prefix sums the counts digit major and scatters, between the
+    range and a buffer. passes in which every key has the same digit are
+    skipped, input already in (reverse) order is done after the first read.
+    false if ctx got cancelled before a pass, the range holds its elements
+ */
+template <class Iterator, class KeyFn>
+bool radix_sort(Iterator first, size_t N, KeyFn key, const Context &ctx) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    using U = decltype(key(*first));
+    constexpr size_t passes = sizeof(U);
+
+    auto nw = std::min(Executor::instance().size(), N / radix_sort_block + 1);
+    auto block = (N + nw - 1) / nw;
+    // a throwing key or move is caught on the worker, rethrown here
+    auto run = [nw](auto &&f) {
+        if (nw == 1) {
+            f(0, 1);
             return;
         }
-        if (d == 1) {
-            if (comp(*right, *left)) {
-                std::swap(*left, *right);
+        std::exception_ptr error;
+        std::mutex error_mtx;
+        {
+            WaitGroup wg{};
+            wg.together(
+                [&](size_t tidx, size_t n) {
+                    try {
+                        f(tidx, n);
+                    } catch (...) {
+                        auto lg = std::lock_guard{error_mtx};
+                        if (!error)
+                            error = std::current_exception();
+                    }
+                },
+                nullptr, nw);
+        }
+        if (error)
+            std::rethrow_exception(error);
+    };
+
+    // one read for the digit totals of every pass, noting on the way
+    // whether a block is already in order or strictly reversed
+    std::vector<size_t> hist(nw * passes * 256, 0);
+    std::vector<char> asc(nw, 1), desc(nw, 1);
+    std::vector<U> head(nw), tail(nw);
+    run([&](size_t t, size_t) {
+        auto h = &hist[t * passes * 256];
+        auto b = std::min(N, t * block), e = std::min(N, b + block);
+        auto up = true, down = true;
+        for (auto i = b; i < e; i++) {
+            auto k = key(first[i]);
+            for (size_t p = 0; p < passes; p++) {
+                h[p * 256 + ((k >> (8 * p)) & 0xff)]++;
             }
-            return;
+            if (i > b) {
+                up = up && !(k < tail[t]);
+                down = down && tail[t] > k;
+            } else {
+                head[t] = k;
+            }
+            tail[t] = k;
+        }
+        asc[t] = up;
+        desc[t] = down;
+    });
+    auto sorted = true, reversed = true;
+    for (size_t t = 0; t < nw && t * block < N; t++) {
+        sorted = sorted && asc[t];
+        reversed = reversed && desc[t];
+        if (t > 0) {
+            sorted = sorted && !(head[t] < tail[t - 1]);
+            reversed = reversed && tail[t - 1] > head[t];
         }
-        auto pivot = left;
-        if (first_pivot) {
-            first_pivot = false;
-            std::advance(pivot, std::rand() % d);
+    }
+    if (sorted)
+        return true;
+    if (reversed) {
+        // no equal keys, reversing keeps it stable
+        std::reverse(first, first + N);
+        return true;
+    }
+    std::vector<size_t> todo;
+    for (size_t p = 0; p < passes; p++) {
+        auto skip = false;
+        for (size_t d = 0; d < 256 && !skip; d++) {
+            size_t total = 0;
+            for (size_t t = 0; t < nw; t++) {
+                total += hist[t * passes * 256 + p * 256 + d];
+            }
+            skip = total == N;
+        }
+        if (!skip) {
+            todo.push_back(p);
+        }
+    }
+    if (todo.empty())
+        return true;
+    if (ctx.cancelled())
+        return false;
+
+    std::allocator<T> alloc;
+    auto buf = alloc.allocate(N);
+    // every slot holds an object once the first pass is through. a throw
+    // in that pass leaves the ones marked in built, nothing before it
+    auto constructed = false;
+    std::vector<char> built;
+    if constexpr (!std::is_trivially_destructible_v<T>)
+        built.assign(N, 0);
+    goxx_defer([&]() {
+        if (constructed) {
+            std::destroy(buf, buf + N);
         } else {
-            std::advance(pivot, d / 2);
-        }
-        auto j = left;
-        std::swap(*pivot, *right);
-        for (auto i = left; i != right; i++) {
-            if (comp(*i, *right)) {
-                std::swap(*i, *j);
-                j++;
+            for (size_t j = 0; j < built.size(); j++) {
+                if (built[j])
+                    std::destroy_at(buf + j);
             }
         }
-        std::swap(*j, *right);
-        pivot = j;
-
-        auto left_d = std::distance(left, pivot);
-        auto right_d = std::distance(pivot + 1, right);
-        if (left_d > right_d) {
-            if (left_d > 0) {
-                if (left_d > thread_limit) {
-                    wg.go([impl, left, pivot]() { impl(left, pivot); });
-                } else {
-                    impl(left, pivot);
+        alloc.deallocate(buf, N);
+    });
+    std::vector<size_t> offs(nw * 256);
+    // construct: dst is the buffer and holds no objects yet
+    auto pass = [&](auto src, auto dst, size_t p, bool construct) {
+        auto shift = 8 * p;
+        if (nw == 1) {
+            // one block, the totals are its counts
+            std::copy(&hist[p * 256], &hist[p * 256] + 256, offs.begin());
+        } else {
+            std::fill(offs.begin(), offs.end(), 0);
+            run([&](size_t t, size_t) {
+                auto o = &offs[t * 256];
+                auto b = std::min(N, t * block), e = std::min(N, b + block);
+                for (auto i = b; i < e; i++) {
+                    o[(key(src[i]) >> shift) & 0xff]++;
                 }
+            });
+        }
+        for (size_t d = 0, sum = 0; d < 256; d++) {
+            for (size_t t = 0; t < nw; t++) {
+                auto c = offs[t * 256 + d];
+                offs[t * 256 + d] = sum;
+                sum += c;
             }
-            if (right_d > 0) {
-                impl(pivot + 1, right);
+        }
+        run([&](size_t t, size_t) {
+            auto o = &offs[t * 256];
+            auto b = std::min(N, t * block), e = std::min(N, b + block);
+            if constexpr (std::is_trivial_v<T> && sizeof(T) <= 16) {
+                // stage a cache line per digit, 256 scattered single
+                // stores thrash the cache and the tlb
+                constexpr size_t K = 64 / sizeof(T);
+                auto stage = std::make_unique<T[]>(256 * K);
+                size_t fill[256] = {};
+                for (auto i = b; i < e; i++) {
+                    auto d = (key(src[i]) >> shift) & 0xff;
+                    stage[d * K + fill[d]++] = src[i];
+                    if (fill[d] == K) {
+                        std::copy(&stage[d * K], &stage[d * K] + K, dst + o[d]);
+                        o[d] += K;
+                        fill[d] = 0;
+                    }
+                }
+                for (size_t d = 0; d < 256; d++) {
+                    std::copy(&stage[d * K], &stage[d * K] + fill[d],
+                              dst + o[d]);
+                }
+            } else {
+                for (auto i = b; i < e; i++) {
+                    auto j = o[(key(src[i]) >> shift) & 0xff]++;
+                    if constexpr (std::is_same_v<decltype(dst), T *>) {
+                        if (construct) {
+                            ::new ((void *)(dst + j)) T(std::move(src[i]));
+                            if constexpr (!std::is_trivially_destructible_v<T>)
+                                built[j] = 1;
+                            continue;
+                        }
+                    }
+                    dst[j] = std::move(src[i]);
+                }
             }
+        });
+    };
+    auto in_buf = false;
+    auto done = true;
+    for (auto p : todo) {
+        if (ctx.cancelled()) {
+            done = false;
+            break;
+        }
+        if (in_buf) {
+            pass(buf, first, p, false);
         } else {
-            if (right_d > 0) {
-                if (right_d > thread_limit) {
-                    wg.go([impl, pivot, right]() { impl(pivot + 1, right); });
-                } else {
-                    impl(pivot + 1, right);
+            pass(first, buf, p, !constructed);
+            constructed = true;
+        }
+        in_buf = !in_buf;
+    }
+    if (in_buf) {
+        run([&](size_t t, size_t) {
+            auto b = std::min(N, t * block), e = std::min(N, b + block);
+            std::move(buf + b, buf + e, first + b);
+        });
+    }
+    return done;
+}
+} // namespace internal
+
+template <class Iterator>
+void mt_sort(Iterator first, Iterator last) {
+    mt_sort(first, last, std::less<>{});
+}
+
+template <class Iterator, class Key, class Compare>
+void mt_sort_by_key(Iterator first, Iterator last, Key key, Compare comp) {
+    mt_sort_by_key(first, last, std::move(key), comp, Context{});
+}
+
+template <class Iterator, class Key, class Compare>
+bool mt_sort_by_key(Iterator first, Iterator last, Key key, Compare comp,
+                    const Context &ctx) {
+    if (ctx.cancelled())
+        return false;
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    using K = std::decay_t<std::invoke_result_t<Key &, const T &>>;
+    auto N = (size_t)std::distance(first, last);
+    auto by_key = [&](const T &a, const T &b) { return comp(key(a), key(b)); };
+    if constexpr (internal::radix_key_type<K> &&
+                  internal::radix_order<Compare, K> != 0) {
+        if (N <= internal::radix_sort_cutoff) {
+            std::stable_sort(first, last, by_key);
+            return true;
+        }
+        return internal::radix_sort(
+            first, N,
+            [&key](const T &v) {
+                auto k = internal::radix_key(key(v));
+                if constexpr (internal::radix_order<Compare, K> < 0)
+                    k = (decltype(k))~k;
+                return k;
+            },
+            ctx);
+    } else {
+        return mt_sort(first, last, by_key, ctx);
+    }
+}
+
+template <class Iterator, class Key>
+void mt_sort_by_key(Iterator first, Iterator last, Key key) {
+    mt_sort_by_key(first, last, std::move(key), std::less<>{});
+}
+
+/*
+    parallel sample sort on the shared Executor
+
+    splitters are picked from a sorted sample. every element goes to the
+    bucket between two splitters, or to the bucket of the splitter it is
+    equal to (three way), so duplicates never need sorting again. buckets
+    are scattered into a buffer and sorted with std::sort by a fixed number
+    of workers, then moved back. once ctx is cancelled the buckets left are
+    moved back unsorted.
+ */
+template <class Iterator, class Compare>
+void mt_sort(Iterator first, Iterator last, Compare comp) {
+    mt_sort(first, last, comp, Context{});
+}
+
+template <class Iterator, class Compare>
+bool mt_sort(Iterator first, Iterator last, Compare comp, const Context &ctx) {
+    if (ctx.cancelled())
+        return false;
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    auto N = (size_t)std::distance(first, last);
+    if constexpr (internal::radix_key_type<T> &&
+                  internal::radix_order<Compare, T> != 0) {
+        if (N > internal::radix_sort_cutoff) {
+            return mt_sort_by_key(
+                first, last, [](const T &v) { return v; }, comp, ctx);
+        }
+    }
+    auto nw = Executor::instance().size();
+    if (N <= internal::mt_sort_cutoff || nw <= 1) {
+        std::sort(first, last, comp);
+        return true;
+    }
+
+    // splitters, equal ones merged. the sample is indices and the splitters
+    // point into the range, T may be move only. they are only compared
+    // before the scatter moves anything
+    auto nb = std::min<size_t>(nw * internal::mt_sort_buckets_per_worker,
+                               N / internal::mt_sort_cutoff + 1);
+    std::vector<Iterator> splitters;
+    {
+        std::minstd_rand rng{(uint32_t)N};
+        std::uniform_int_distribution<size_t> pick{0, N - 1};
+        std::vector<size_t> sample(nb * internal::mt_sort_oversample);
+        for (auto &i : sample) {
+            i = pick(rng);
+        }
+        std::sort(sample.begin(), sample.end(), [&](size_t a, size_t b) {
+            return comp(first[a], first[b]);
+        });
+        for (size_t i = 1; i < nb; i++) {
+            auto s = first + sample[i * internal::mt_sort_oversample];
+            if (splitters.empty() || comp(*splitters.back(), *s)) {
+                splitters.push_back(s);
+            }
+        }
+    }
+    // bucket 2i holds the elements below splitter i, 2i + 1 the equal ones
+    auto nbuckets = splitters.size() * 2 + 1;
+    auto bucket_of = [&](const T &v) -> uint32_t {
+        auto it = std::lower_bound(
+            splitters.begin(), splitters.end(), v,
+            [&](const Iterator &s, const T &x) { return comp(*s, x); });
+        auto i = (uint32_t)(it - splitters.begin());
+        return it != splitters.end() && !comp(v, **it) ? 2 * i + 1 : 2 * i;
+    };
+
+    // a throwing comp or move is caught on the worker, the caller rethrows
+    // it once buf is cleaned up. the range keeps valid values, not all of
+    // them: the ones in buf when it happened are destroyed
+    std::exception_ptr error;
+    std::mutex error_mtx;
+    auto fail = [&]() {
+        auto lg = std::lock_guard{error_mtx};
+        if (!error)
+            error = std::current_exception();
+    };
+
+    // classify and count per block
+    auto block = (N + nw - 1) / nw;
+    std::vector<uint32_t> which(N);
+    std::vector<size_t> counts(nw * nbuckets, 0);
+    {
+        WaitGroup wg{};
+        wg.together(
+            [&](size_t tidx, size_t) {
+                auto b = tidx * block, e = std::min(N, b + block);
+                auto cnt = &counts[tidx * nbuckets];
+                try {
+                    for (auto i = b; i < e; i++) {
+                        which[i] = bucket_of(first[i]);
+                        cnt[which[i]]++;
+                    }
+                } catch (...) {
+                    fail();
+                }
+            },
+            nullptr, nw);
+    }
+    if (error)
+        std::rethrow_exception(error);
+    if (ctx.cancelled())
+        return false;
+
+    // counts become write offsets, bucket major then block
+    std::vector<size_t> bucket_start(nbuckets + 1, 0);
+    for (size_t bk = 0, sum = 0; bk < nbuckets; bk++) {
+        bucket_start[bk] = sum;
+        for (size_t t = 0; t < nw; t++) {
+            auto c = counts[t * nbuckets + bk];
+            counts[t * nbuckets + bk] = sum;
+            sum += c;
+        }
+        bucket_start[bk + 1] = sum;
+    }
+
+    // scatter into raw storage, sort each bucket, move back
+    std::allocator<T> alloc;
+    auto buf = alloc.allocate(N);
+    goxx_defer([&]() { alloc.deallocate(buf, N); });
+    {
+        // what a block moved before a throw, replayed to destroy it
+        auto offsets = counts;
+        std::vector<size_t> moved_to(nw);
+        {
+            WaitGroup wg{};
+            wg.together(
+                [&](size_t tidx, size_t) {
+                    auto b = tidx * block, e = std::min(N, b + block);
+                    auto off = &counts[tidx * nbuckets];
+                    auto i = b;
+                    try {
+                        for (; i < e; i++) {
+                            ::new ((void *)(buf + off[which[i]]++))
+                                T(std::move(first[i]));
+                        }
+                    } catch (...) {
+                        fail();
+                    }
+                    moved_to[tidx] = i;
+                },
+                nullptr, nw);
+        }
+        if (error) {
+            for (size_t t = 0; t < nw; t++) {
+                auto off = &offsets[t * nbuckets];
+                for (auto i = t * block; i < moved_to[t]; i++) {
+                    std::destroy_at(buf + off[which[i]]++);
                 }
             }
-            if (left_d > 0) {
-                impl(left, pivot);
+            std::rethrow_exception(error);
+        }
+    }
+    std::atomic<bool> skipped{false};
+    std::vector<char> in_buf(nbuckets, 1);
+    {
+        std::atomic<size_t> next{0};
+        WaitGroup wg{};
+        wg.together(
+            [&](size_t, size_t) {
+                for (;;) {
+                    auto bk = next.fetch_add(1, std::memory_order_relaxed);
+                    if (bk >= nbuckets)
+                        return;
+                    auto b = bucket_start[bk], e = bucket_start[bk + 1];
+                    try {
+                        if (bk % 2 == 0 && e - b > 1) {
+                            if (ctx.cancelled()) {
+                                skipped.store(true,
+                                              std::memory_order_relaxed);
+                            } else {
+                                std::sort(buf + b, buf + e, comp);
+                            }
+                        }
+                        std::move(buf + b, buf + e, first + b);
+                    } catch (...) {
+                        fail();
+                        continue;
+                    }
+                    std::destroy(buf + b, buf + e);
+                    in_buf[bk] = 0;
+                }
+            },
+            nullptr, nw);
+    }
+    if (error) {
+        for (size_t bk = 0; bk < nbuckets; bk++) {
+            if (in_buf[bk]) {
+                std::destroy(buf + bucket_start[bk],
+                             buf + bucket_start[bk + 1]);
             }
         }
-        // if (std::distance(left, pivot) > 0) {
-        //     wg.go([impl, left, pivot]() { impl(left, pivot); });
-        //     // impl(left, pivot);
-        // }
-        // if (std::distance(pivot + 1, right) > 0) {
-        //     wg.go([impl, pivot, right]() { impl(pivot + 1, right); });
-        //     // impl(pivot + 1, right);
-        // }
-    };
-    impl(first, std::prev(last));
-    wg.wait();
+        std::rethrow_exception(error);
+    }
+    return !skipped.load(std::memory_order_relaxed);
 }
 
-} // namespace goxx
\ No newline at end of file
+} // namespace goxx
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+
+namespace goxx {
+
+// assumed destructive interference size, keeps hot atomics on their own line
+inline constexpr std::size_t cache_line_size = 64;
+
+/*
+    value padded to a full cache line, for per-thread / per-index counters
+ */
+template <class T>
+struct alignas(cache_line_size) Padded {
+    T value{};
+};
+
+} // namespace goxx
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+
+namespace goxx {
+/*
+    data parallel loops on the shared Executor, random access iterators.
+
+    the range is cut in grain sized chunks, every worker starts on a
+    contiguous share of them and takes one chunk at a time from its front,
+    a worker out of chunks steals the back half of another worker's share.
+    grain 0 picks one from the size of the range and of the pool.
+ */
+
+// f(element) for every element
+template <class Iterator, class F>
+void parallel_for(Iterator first, Iterator last, F f, size_t grain = 0);
+
+// like std::reduce: op must be associative and commutative, the order in
+// which elements are combined is unspecified
+template <class Iterator, class T, class BinaryOp>
+T parallel_reduce(Iterator first, Iterator last, T init, BinaryOp op,
+                  size_t grain = 0);
+
+template <class Iterator, class T>
+T parallel_reduce(Iterator first, Iterator last, T init);
+
+// d_first[i] = op(first[i]), returns the end of the output
+template <class Iterator, class OutputIt, class UnaryOp>
+OutputIt parallel_transform(Iterator first, Iterator last, OutputIt d_first,
+                            UnaryOp op, size_t grain = 0);
+
+// like std::inclusive_scan, op must be associative. d_first may be first
+template <class Iterator, class OutputIt, class BinaryOp>
+OutputIt parallel_inclusive_scan(Iterator first, Iterator last,
+                                 OutputIt d_first, BinaryOp op,
+                                 size_t grain = 0);
+
+template <class Iterator, class OutputIt>
+OutputIt parallel_inclusive_scan(Iterator first, Iterator last,
+                                 OutputIt d_first);
+} // namespace goxx
+
+#include "goxx/parallel.ipp"
@@ -0,0 +1,226 @@
+#pragma once
+#include "goxx/executor.hpp"
+#include "goxx/padded.hpp"
+#include "goxx/parallel.hpp"
+#include "goxx/wait_group.hpp"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+namespace goxx {
+
+namespace internal {
+// largest automatic grain, a chunk should dwarf a lock / unlock
+inline constexpr size_t parallel_grain = 1 << 12;
+// automatic grain leaves at least this many chunks per worker to steal
+inline constexpr size_t parallel_chunks_per_worker = 8;
+
+inline size_t parallel_grain_for(size_t N, size_t grain) {
+    if (grain > 0)
+        return grain;
+    auto nw = Executor::instance().size();
+    return std::clamp<size_t>(N / (nw * parallel_chunks_per_worker), 1,
+                              parallel_grain);
+}
+
+inline size_t parallel_workers(size_t N, size_t grain) {
+    return std::max<size_t>(
+        1, std::min(Executor::instance().size(), (N + grain - 1) / grain));
+}
+
+/*
+    body(b, e, worker) for chunks [b, e) covering [0, N), b is a multiple of
+    grain and worker < nw. each worker owns a span of chunk indices and
+    takes from its front, a thief moves the back half of a victim's span
+    into its own, so the spans stay contiguous
+ */
+template <class Body>
+void parallel_chunks(size_t N, size_t grain, size_t nw, Body &&body) {
+    auto chunks = (N + grain - 1) / grain;
+    auto run = [&](size_t c, size_t t) {
+        body(c * grain, std::min(N, (c + 1) * grain), t);
+    };
+    if (nw <= 1) {
+        for (size_t c = 0; c < chunks; c++) {
+            run(c, 0);
+        }
+        return;
+    }
+    struct alignas(cache_line_size) Span {
+        std::mutex mtx;
+        size_t b = 0;
+        size_t e = 0;
+    };
+    std::unique_ptr<Span[]> spans{new Span[nw]};
+    for (size_t t = 0; t < nw; t++) {
+        spans[t].b = chunks * t / nw;
+        spans[t].e = chunks * (t + 1) / nw;
+    }
+    auto next = [&](size_t t, size_t &c) {
+        auto &own = spans[t];
+        {
+            auto lg = std::lock_guard{own.mtx};
+            if (own.b < own.e) {
+                c = own.b++;
+                return true;
+            }
+        }
+        for (size_t i = 1; i < nw; i++) {
+            auto &victim = spans[(t + i) % nw];
+            size_t b, e;
+            {
+                auto lg = std::lock_guard{victim.mtx};
+                if (victim.b >= victim.e)
+                    continue;
+                // the last chunk goes whole
+                b = victim.b + (victim.e - victim.b) / 2;
+                e = victim.e;
+                victim.e = b;
+            }
+            auto lg = std::lock_guard{own.mtx};
+            own.b = b + 1;
+            own.e = e;
+            c = b;
+            return true;
+        }
+        return false;
+    };
+    WaitGroup wg{};
+    wg.together(
+        [&](size_t t, size_t) {
+            for (size_t c; next(t, c);) {
+                run(c, t);
+            }
+        },
+        nullptr, nw);
+}
+} // namespace internal
+
+template <class Iterator, class F>
+void parallel_for(Iterator first, Iterator last, F f, size_t grain) {
+    auto N = (size_t)(last - first);
+    if (N == 0)
+        return;
+    grain = internal::parallel_grain_for(N, grain);
+    internal::parallel_chunks(
+        N, grain, internal::parallel_workers(N, grain),
+        [&](size_t b, size_t e, size_t) {
+            for (auto itr = first + b, end = first + e; itr != end; ++itr) {
+                f(*itr);
+            }
+        });
+}
+
+/*
+    every worker folds its chunks into an accumulator of its own, on its own
+    cache line, the accumulators meet init at the end
+ */
+template <class Iterator, class T, class BinaryOp>
+T parallel_reduce(Iterator first, Iterator last, T init, BinaryOp op,
+                  size_t grain) {
+    auto N = (size_t)(last - first);
+    if (N == 0)
+        return init;
+    grain = internal::parallel_grain_for(N, grain);
+    auto nw = internal::parallel_workers(N, grain);
+    std::vector<Padded<std::optional<T>>> acc(nw);
+    internal::parallel_chunks(
+        N, grain, nw, [&](size_t b, size_t e, size_t t) {
+            // std::reduce may reorder within the chunk too, and unrolls
+            T local = std::reduce(first + b + 1, first + e, T(first[b]), op);
+            auto &a = acc[t].value;
+            if (a) {
+                a = op(std::move(*a), std::move(local));
+            } else {
+                a = std::move(local);
+            }
+        });
+    for (auto &a : acc) {
+        if (a.value)
+            init = op(std::move(init), std::move(*a.value));
+    }
+    return init;
+}
+
+template <class Iterator, class T>
+T parallel_reduce(Iterator first, Iterator last, T init) {
+    return parallel_reduce(first, last, std::move(init), std::plus<>{});
+}
+
+template <class Iterator, class OutputIt, class UnaryOp>
+OutputIt parallel_transform(Iterator first, Iterator last, OutputIt d_first,
+                            UnaryOp op, size_t grain) {
+    auto N = (size_t)(last - first);
+    if (N == 0)
+        return d_first;
+    grain = internal::parallel_grain_for(N, grain);
+    internal::parallel_chunks(
+        N, grain, internal::parallel_workers(N, grain),
+        [&](size_t b, size_t e, size_t) {
+            auto out = d_first + b;
+            for (auto itr = first + b, end = first + e; itr != end;
+                 ++itr, ++out) {
+                *out = op(*itr);
+            }
+        });
+    return d_first + N;
+}
+
+/*
+    two passes over the chunks: the first reduces every chunk, a serial scan
+    over the chunk sums gives each chunk its carry, the second scans every
+    chunk starting from its carry
+ */
+template <class Iterator, class OutputIt, class BinaryOp>
+OutputIt parallel_inclusive_scan(Iterator first, Iterator last,
+                                 OutputIt d_first, BinaryOp op,
+                                 size_t grain) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    auto N = (size_t)(last - first);
+    grain = internal::parallel_grain_for(N, grain);
+    auto nw = internal::parallel_workers(N, grain);
+    if (nw <= 1)
+        return std::inclusive_scan(first, last, d_first, op);
+    auto chunks = (N + grain - 1) / grain;
+    std::vector<std::optional<T>> carry(chunks);
+    internal::parallel_chunks(N, grain, nw, [&](size_t b, size_t e, size_t) {
+        auto itr = first + b, end = first + e;
+        T local = *itr;
+        for (++itr; itr != end; ++itr) {
+            local = op(std::move(local), *itr);
+        }
+        carry[b / grain] = std::move(local);
+    });
+    // carry[c] becomes the sum of the chunks before c
+    std::optional<T> sum;
+    for (auto &c : carry) {
+        auto next = sum ? op(*sum, *c) : *c;
+        c = std::move(sum);
+        sum = std::move(next);
+    }
+    internal::parallel_chunks(N, grain, nw, [&](size_t b, size_t e, size_t) {
+        auto itr = first + b, end = first + e;
+        auto out = d_first + b;
+        auto &c = carry[b / grain];
+        T acc = c ? op(*c, *itr) : T(*itr);
+        *out = acc;
+        for (++itr, ++out; itr != end; ++itr, ++out) {
+            acc = op(std::move(acc), *itr);
+            *out = acc;
+        }
+    });
+    return d_first + N;
+}
+
+template <class Iterator, class OutputIt>
+OutputIt parallel_inclusive_scan(Iterator first, Iterator last,
+                                 OutputIt d_first) {
+    return parallel_inclusive_scan(first, last, d_first, std::plus<>{});
+}
+
+} // namespace goxx
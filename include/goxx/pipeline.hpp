@@ -0,0 +1,133 @@
+#pragma once
+
+#include "goxx/chan.hpp"
+#include "goxx/wait_group.hpp"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace goxx {
+/*
+    stream pipelines over Chan
+
+        using namespace goxx::pipeline;
+        from(v.begin(), v.end())
+            | map(parse, 8)          // 8 workers
+            | filter(valid)
+            | batch(64)
+            | sink(store);           // runs the pipeline, blocks until done
+
+    stages run on the shared Executor. map(f) / filter / batch are fused
+    into the stage before them: a value goes through them by plain calls on
+    the same thread. map(f, n) starts a stage of n workers behind a bounded
+    Chan, that Chan is where backpressure comes from. the stages after an
+    unordered map(f, n) are fused into its workers, so batch there makes
+    batches per worker. map(f, n, true) keeps the input order, its results
+    go through a reorder buffer of at most `buffer` values and the stages
+    after it run on the thread that drains it.
+
+    sink(f) / collect() call f on one thread at a time, after a parallel
+    stage they get a thread of their own.
+
+    end of stream: the source returning closes the chan to the next stage
+    once every worker feeding it is done, and so on down the pipeline.
+    functors are copied per worker.
+ */
+namespace pipeline {
+
+// values in flight between two stages, per Chan
+inline constexpr size_t default_buffer = 256;
+
+template <class T, class Start>
+class Stream {
+  public:
+    using value_type = T;
+
+    // start(wg, make_emit): launches the stages on wg, pushing to one
+    // emitter from make_emit() per worker of the last stage
+    Stream(Start start, bool parallel)
+        : start_(std::move(start)), parallel_(parallel) {}
+
+    Start start_;
+    bool parallel_; // the last stage has more than one worker
+};
+
+template <class F>
+struct MapOp {
+    F f;
+};
+template <class F>
+struct ParallelMapOp {
+    F f;
+    size_t parallelism;
+    bool ordered;
+    size_t buffer;
+};
+template <class F>
+struct FilterOp {
+    F f;
+};
+struct BatchOp {
+    size_t n;
+};
+template <class F>
+struct SinkOp {
+    F f;
+};
+struct CollectOp {};
+
+/* sources */
+
+// copies of *first ... *(last - 1)
+template <class Iterator>
+auto from(Iterator first, Iterator last);
+
+// values popped from ch until it is closed and drained
+template <class T>
+auto from(Chan<T> &ch);
+
+// f() -> std::optional<T> until it returns nullopt
+template <class F>
+auto generate(F f);
+
+/* stages */
+
+template <class F>
+MapOp<F> map(F f);
+
+template <class F>
+ParallelMapOp<F> map(F f, size_t parallelism, bool ordered = false,
+                     size_t buffer = default_buffer);
+
+template <class F>
+FilterOp<F> filter(F pred);
+
+// std::vector<T> of n values, the last one may be shorter
+BatchOp batch(size_t n);
+
+/* ends, run the whole pipeline */
+
+template <class F>
+SinkOp<F> sink(F f);
+
+CollectOp collect(); // -> std::vector<T>
+
+template <class T, class S, class F>
+auto operator|(Stream<T, S> s, MapOp<F> op);
+template <class T, class S, class F>
+auto operator|(Stream<T, S> s, ParallelMapOp<F> op);
+template <class T, class S, class F>
+auto operator|(Stream<T, S> s, FilterOp<F> op);
+template <class T, class S>
+auto operator|(Stream<T, S> s, BatchOp op);
+template <class T, class S, class F>
+void operator|(Stream<T, S> s, SinkOp<F> op);
+template <class T, class S>
+std::vector<T> operator|(Stream<T, S> s, CollectOp);
+
+} // namespace pipeline
+} // namespace goxx
+
+#include "goxx/pipeline.ipp"
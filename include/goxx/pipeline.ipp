@@ -0,0 +1,312 @@
+#pragma once
+
+#include "goxx/pipeline.hpp"
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace goxx {
+
+namespace internal {
+/*
+    emitters take the values a worker of a stage produces: push(value) per
+    value, finish() once the worker is done. the fused stages are emitters
+    wrapping the next one
+ */
+template <class F, class Next>
+struct MapEmit {
+    F f;
+    Next next;
+    template <class U>
+    void push(U &&x) {
+        next.push(f(std::forward<U>(x)));
+    }
+    void finish() { next.finish(); }
+};
+
+template <class F, class Next>
+struct FilterEmit {
+    F f;
+    Next next;
+    template <class U>
+    void push(U &&x) {
+        if (f(std::as_const(x)))
+            next.push(std::forward<U>(x));
+    }
+    void finish() { next.finish(); }
+};
+
+template <class T, class Next>
+struct BatchEmit {
+    size_t n;
+    Next next;
+    std::vector<T> batch;
+    template <class U>
+    void push(U &&x) {
+        batch.push_back(std::forward<U>(x));
+        if (batch.size() >= n) {
+            next.push(std::move(batch));
+            batch = std::vector<T>{};
+            batch.reserve(n);
+        }
+    }
+    void finish() {
+        if (!batch.empty())
+            next.push(std::move(batch));
+        next.finish();
+    }
+};
+
+template <class F>
+struct SinkEmit {
+    F *f;
+    template <class U>
+    void push(U &&x) {
+        (*f)(std::forward<U>(x));
+    }
+    void finish() {}
+};
+
+// feeds the chan of the next stage, the last of its feeders closes it
+template <class T>
+struct ChanEmit {
+    std::shared_ptr<Chan<T>> ch;
+    std::shared_ptr<std::atomic<size_t>> live;
+    ChanEmit(std::shared_ptr<Chan<T>> ch,
+             std::shared_ptr<std::atomic<size_t>> live)
+        : ch(std::move(ch)), live(std::move(live)) {
+        this->live->fetch_add(1);
+    }
+    template <class U>
+    void push(U &&x) {
+        ch->push(T(std::forward<U>(x)));
+    }
+    void finish() {
+        if (live->fetch_sub(1) == 1)
+            ch->close();
+    }
+};
+
+// same, numbering the values for an ordered stage. a value needs a token,
+// the reorder side gives it back once the value is out
+template <class T>
+struct SeqEmit : ChanEmit<std::pair<size_t, T>> {
+    std::shared_ptr<std::atomic<size_t>> seq;
+    std::shared_ptr<Chan<char>> tokens;
+    SeqEmit(std::shared_ptr<Chan<std::pair<size_t, T>>> ch,
+            std::shared_ptr<std::atomic<size_t>> live,
+            std::shared_ptr<std::atomic<size_t>> seq,
+            std::shared_ptr<Chan<char>> tokens)
+        : ChanEmit<std::pair<size_t, T>>(std::move(ch), std::move(live)),
+          seq(std::move(seq)), tokens(std::move(tokens)) {}
+    template <class U>
+    void push(U &&x) {
+        this->tokens->pop();
+        this->ch->push({seq->fetch_add(1), T(std::forward<U>(x))});
+    }
+};
+
+template <class T, class S, class F>
+void run_pipeline(pipeline::Stream<T, S> s, F &f) {
+    WaitGroup wg{};
+    s.start_(wg, [&]() { return SinkEmit<F>{&f}; });
+    wg.wait();
+}
+} // namespace internal
+
+namespace pipeline {
+
+template <class Iterator>
+auto from(Iterator first, Iterator last) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    auto start = [first, last](WaitGroup &wg, auto make_emit) {
+        wg.go([first, last, e = make_emit()]() mutable {
+            for (auto itr = first; itr != last; ++itr) {
+                e.push(T(*itr));
+            }
+            e.finish();
+        });
+    };
+    return Stream<T, decltype(start)>{std::move(start), false};
+}
+
+template <class T>
+auto from(Chan<T> &ch) {
+    auto start = [&ch](WaitGroup &wg, auto make_emit) {
+        wg.go([&ch, e = make_emit()]() mutable {
+            for (auto x : ch) {
+                e.push(std::move(x));
+            }
+            e.finish();
+        });
+    };
+    return Stream<T, decltype(start)>{std::move(start), false};
+}
+
+template <class F>
+auto generate(F f) {
+    using T = typename std::invoke_result_t<F &>::value_type;
+    auto start = [f = std::move(f)](WaitGroup &wg, auto make_emit) {
+        wg.go([f, e = make_emit()]() mutable {
+            while (auto x = f()) {
+                e.push(std::move(*x));
+            }
+            e.finish();
+        });
+    };
+    return Stream<T, decltype(start)>{std::move(start), false};
+}
+
+template <class F>
+MapOp<F> map(F f) {
+    return MapOp<F>{std::move(f)};
+}
+
+template <class F>
+ParallelMapOp<F> map(F f, size_t parallelism, bool ordered, size_t buffer) {
+    return ParallelMapOp<F>{std::move(f), std::max<size_t>(1, parallelism),
+                            ordered, std::max<size_t>(1, buffer)};
+}
+
+template <class F>
+FilterOp<F> filter(F pred) {
+    return FilterOp<F>{std::move(pred)};
+}
+
+inline BatchOp batch(size_t n) { return BatchOp{std::max<size_t>(1, n)}; }
+
+template <class F>
+SinkOp<F> sink(F f) {
+    return SinkOp<F>{std::move(f)};
+}
+
+inline CollectOp collect() { return CollectOp{}; }
+
+template <class T, class S, class F>
+auto operator|(Stream<T, S> s, MapOp<F> op) {
+    using U = std::decay_t<std::invoke_result_t<F &, T &&>>;
+    auto start = [start = std::move(s.start_),
+                  f = std::move(op.f)](WaitGroup &wg, auto make_emit) {
+        start(wg, [&]() {
+            return internal::MapEmit<F, decltype(make_emit())>{f,
+                                                                make_emit()};
+        });
+    };
+    return Stream<U, decltype(start)>{std::move(start), s.parallel_};
+}
+
+template <class T, class S, class F>
+auto operator|(Stream<T, S> s, FilterOp<F> op) {
+    auto start = [start = std::move(s.start_),
+                  f = std::move(op.f)](WaitGroup &wg, auto make_emit) {
+        start(wg, [&]() {
+            return internal::FilterEmit<F, decltype(make_emit())>{
+                f, make_emit()};
+        });
+    };
+    return Stream<T, decltype(start)>{std::move(start), s.parallel_};
+}
+
+template <class T, class S>
+auto operator|(Stream<T, S> s, BatchOp op) {
+    auto start = [start = std::move(s.start_), n = op.n](WaitGroup &wg,
+                                                         auto make_emit) {
+        start(wg, [&]() {
+            return internal::BatchEmit<T, decltype(make_emit())>{
+                n, make_emit(), {}};
+        });
+    };
+    return Stream<std::vector<T>, decltype(start)>{std::move(start),
+                                                   s.parallel_};
+}
+
+/*
+    every emitter of a stage exists before any of its workers starts, so
+    the live count of a chan is complete before a feeder can finish
+ */
+template <class T, class S, class F>
+auto operator|(Stream<T, S> s, ParallelMapOp<F> op) {
+    using U = std::decay_t<std::invoke_result_t<F &, T &&>>;
+    auto parallel = !op.ordered && op.parallelism > 1;
+    auto start = [start = std::move(s.start_),
+                  op = std::move(op)](WaitGroup &wg, auto make_emit) {
+        auto live = std::make_shared<std::atomic<size_t>>(0);
+        if (!op.ordered) {
+            auto in = std::make_shared<Chan<T>>(op.buffer);
+            std::vector<decltype(make_emit())> emits;
+            for (size_t i = 0; i < op.parallelism; i++) {
+                emits.push_back(make_emit());
+            }
+            for (auto &e : emits) {
+                wg.go([in, f = op.f, e = std::move(e)]() mutable {
+                    for (auto x : *in) {
+                        e.push(f(std::move(x)));
+                    }
+                    e.finish();
+                });
+            }
+            start(wg, [&]() { return internal::ChanEmit<T>{in, live}; });
+            return;
+        }
+        // at most w values between the numbering and the reorder ring
+        auto w = op.buffer;
+        auto in = std::make_shared<Chan<std::pair<size_t, T>>>(w);
+        auto out = std::make_shared<Chan<std::pair<size_t, U>>>(w);
+        auto tokens = std::make_shared<Chan<char>>(w);
+        for (size_t i = 0; i < w; i++) {
+            tokens->push(0);
+        }
+        wg.go([out, tokens, w, e = make_emit()]() mutable {
+            std::vector<std::optional<U>> ring(w);
+            size_t next = 0;
+            for (auto p : *out) {
+                ring[p.first % w] = std::move(p.second);
+                for (auto *r = &ring[next % w]; *r; r = &ring[next % w]) {
+                    e.push(std::move(**r));
+                    r->reset();
+                    next++;
+                    tokens->push(0);
+                }
+            }
+            e.finish();
+        });
+        auto workers = std::make_shared<std::atomic<size_t>>(op.parallelism);
+        for (size_t i = 0; i < op.parallelism; i++) {
+            wg.go([in, out, workers, f = op.f]() mutable {
+                for (auto p : *in) {
+                    out->push({p.first, f(std::move(p.second))});
+                }
+                if (workers->fetch_sub(1) == 1)
+                    out->close();
+            });
+        }
+        auto seq = std::make_shared<std::atomic<size_t>>(0);
+        start(wg, [&]() {
+            return internal::SeqEmit<T>{in, live, seq, tokens};
+        });
+    };
+    return Stream<U, decltype(start)>{std::move(start), parallel};
+}
+
+template <class T, class S, class F>
+void operator|(Stream<T, S> s, SinkOp<F> op) {
+    if (s.parallel_) {
+        // one more hop, so that f is never called concurrently
+        internal::run_pipeline(
+            std::move(s) | map([](T &&x) -> T { return std::move(x); }, 1),
+            op.f);
+    } else {
+        internal::run_pipeline(std::move(s), op.f);
+    }
+}
+
+template <class T, class S>
+std::vector<T> operator|(Stream<T, S> s, CollectOp) {
+    std::vector<T> res;
+    std::move(s) | sink([&res](T x) { res.push_back(std::move(x)); });
+    return res;
+}
+
+} // namespace pipeline
+} // namespace goxx
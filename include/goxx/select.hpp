@@ -0,0 +1,71 @@
+#pragma once
+
+#include "goxx/chan.hpp"
+#include "goxx/selector.hpp"
+#include <chrono>
+#include <cstddef>
+
+namespace goxx {
+/*
+        GO style select
+
+        goxx::select(
+            recv(ch1, [](int v) { }),
+            recv(ch2, cases{
+                          [](std::string s) { },
+                          [](Closed) { }, // ch2 is closed and drained
+                      }),
+            send(ch3, 42, []() { }),
+            timeout(100ms, []() { }), // or deadline(time_point, f)
+            otherwise([]() { }));     // go's default case
+
+        exactly one ready case runs, ties are broken randomly. without a
+        ready case the thread parks on every chan involved until one of them
+        changes state or the deadline passes.
+
+        a recv / send handler that does not accept Closed just disables its
+        case once the chan is closed, like a nil chan in go.
+
+        returns the index of the case that ran, select_none when every case
+        is disabled and there is neither otherwise nor a deadline.
+ */
+
+struct Closed {};
+
+inline constexpr size_t select_none = ~size_t{0};
+
+namespace internal {
+template <class T, class F>
+struct RecvCase;
+template <class T, class F>
+struct SendCase;
+template <class F>
+struct DefaultCase;
+template <class F>
+struct DeadlineCase;
+} // namespace internal
+
+template <class T, class F>
+auto recv(Chan<T> &ch, F &&f) -> internal::RecvCase<T, std::decay_t<F>>;
+
+template <class T, class F>
+auto send(Chan<T> &ch, T value, F &&f)
+    -> internal::SendCase<T, std::decay_t<F>>;
+
+template <class F>
+auto otherwise(F &&f) -> internal::DefaultCase<std::decay_t<F>>;
+
+template <class F>
+auto deadline(std::chrono::steady_clock::time_point tp, F &&f)
+    -> internal::DeadlineCase<std::decay_t<F>>;
+
+template <class Rep, class Period, class F>
+auto timeout(std::chrono::duration<Rep, Period> d, F &&f)
+    -> internal::DeadlineCase<std::decay_t<F>>;
+
+template <class... Cases>
+size_t select(Cases &&...cases);
+
+} // namespace goxx
+
+#include "goxx/select.ipp"
@@ -0,0 +1,331 @@
+#pragma once
+
+#include "goxx/defer.hpp"
+#include "goxx/select.hpp"
+#include <functional>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace goxx {
+
+namespace internal {
+
+/*
+    chan cases are used in two steps: poll() takes the value out of the chan
+    (or notices it is closed), run() calls the handler once select has left
+    every chan. on an unbuffered chan the parked select also queues rv, a
+    counterpart that wins claim completes it while select sleeps
+ */
+template <class T, class F>
+struct RecvCase {
+    Chan<T> *ch;
+    F f;
+    bool disabled = false;
+    std::optional<T> value{};
+    Rendezvous<T> rv{};
+
+    bool poll() {
+        if (disabled)
+            return false;
+        if (value = ch->try_pop(); value)
+            return true;
+        if (ch->exhausted()) {
+            if constexpr (std::is_invocable_v<F &, Closed>) {
+                return true;
+            } else {
+                disabled = true;
+            }
+        }
+        return false;
+    }
+    void run() {
+        if constexpr (std::is_invocable_v<F &, Closed>) {
+            if (!value) {
+                f(Closed{});
+                return;
+            }
+        }
+        f(std::move(*value));
+    }
+    bool handed_off() const {
+        return rv.done.load(std::memory_order_acquire);
+    }
+    void attach(Selector *s, std::atomic<bool> *claim) {
+        if (disabled)
+            return;
+        rv.slot = &value;
+        rv.selector = s;
+        rv.claim = claim;
+        ChanAccess::attach(*ch, s, &rv, false);
+    }
+    void detach(Selector *s) { ChanAccess::detach(*ch, s, &rv, false); }
+};
+
+template <class T, class F>
+struct SendCase {
+    Chan<T> *ch;
+    T value;
+    F f;
+    bool disabled = false;
+    bool sent = false;
+    Rendezvous<T> rv{};
+
+    bool poll() {
+        if (disabled)
+            return false;
+        if (ch->closed()) {
+            if constexpr (std::is_invocable_v<F &, Closed>) {
+                return true;
+            } else {
+                disabled = true;
+                return false;
+            }
+        }
+        // try_push only moves from value when it succeeds
+        sent = ch->try_push(std::move(value));
+        return sent;
+    }
+    void run() {
+        if constexpr (std::is_invocable_v<F &, Closed>) {
+            if (!sent) {
+                f(Closed{});
+                return;
+            }
+        }
+        f();
+    }
+    bool handed_off() {
+        sent = rv.done.load(std::memory_order_acquire);
+        return sent;
+    }
+    void attach(Selector *s, std::atomic<bool> *claim) {
+        if (disabled)
+            return;
+        rv.value = &value;
+        rv.selector = s;
+        rv.claim = claim;
+        ChanAccess::attach(*ch, s, &rv, true);
+    }
+    void detach(Selector *s) { ChanAccess::detach(*ch, s, &rv, true); }
+};
+
+template <class F>
+struct DefaultCase {
+    F f;
+};
+
+template <class F>
+struct DeadlineCase {
+    std::chrono::steady_clock::time_point tp;
+    F f;
+};
+
+template <class C>
+struct IsDefaultCase : std::false_type {};
+template <class F>
+struct IsDefaultCase<DefaultCase<F>> : std::true_type {};
+
+template <class C>
+struct IsDeadlineCase : std::false_type {};
+template <class F>
+struct IsDeadlineCase<DeadlineCase<F>> : std::true_type {};
+
+template <class C>
+inline constexpr bool is_chan_case =
+    !IsDefaultCase<C>::value && !IsDeadlineCase<C>::value;
+
+// call fn on the idx-th element of a tuple
+template <class Tuple, class Fn, size_t... I>
+void visit_at(Tuple &t, size_t idx, Fn &&fn, std::index_sequence<I...>) {
+    ((I == idx ? (void)fn(std::get<I>(t)) : void()), ...);
+}
+
+// start polling at a random case, so one busy chan can not starve the rest
+inline size_t select_start(size_t n) {
+    thread_local auto x = (uint32_t)std::hash<std::thread::id>{}(
+                              std::this_thread::get_id()) |
+                          1u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x % n;
+}
+
+} // namespace internal
+
+template <class T, class F>
+auto recv(Chan<T> &ch, F &&f) -> internal::RecvCase<T, std::decay_t<F>> {
+    return {&ch, std::forward<F>(f)};
+}
+
+template <class T, class F>
+auto send(Chan<T> &ch, T value, F &&f)
+    -> internal::SendCase<T, std::decay_t<F>> {
+    return {&ch, std::move(value), std::forward<F>(f)};
+}
+
+template <class F>
+auto otherwise(F &&f) -> internal::DefaultCase<std::decay_t<F>> {
+    return {std::forward<F>(f)};
+}
+
+template <class F>
+auto deadline(std::chrono::steady_clock::time_point tp, F &&f)
+    -> internal::DeadlineCase<std::decay_t<F>> {
+    return {tp, std::forward<F>(f)};
+}
+
+template <class Rep, class Period, class F>
+auto timeout(std::chrono::duration<Rep, Period> d, F &&f)
+    -> internal::DeadlineCase<std::decay_t<F>> {
+    return {std::chrono::steady_clock::now() + d, std::forward<F>(f)};
+}
+
+template <class... Cases>
+size_t select(Cases &&...cases) {
+    constexpr auto N = sizeof...(Cases);
+    static_assert(N > 0, "select needs at least one case");
+    static_assert(
+        (internal::IsDefaultCase<std::decay_t<Cases>>::value + ... + 0) <= 1,
+        "select takes at most one otherwise case");
+    static_assert(
+        (internal::IsDeadlineCase<std::decay_t<Cases>>::value + ... + 0) <= 1,
+        "select takes at most one deadline / timeout case");
+
+    std::tuple<Cases &...> cs{cases...};
+    auto seq = std::index_sequence_for<Cases...>{};
+
+    auto default_idx = select_none;
+    auto deadline_idx = select_none;
+    std::optional<std::chrono::steady_clock::time_point> tp;
+    for (size_t i = 0; i < N; i++) {
+        internal::visit_at(
+            cs, i,
+            [&](auto &c) {
+                using C = std::decay_t<decltype(c)>;
+                if constexpr (internal::IsDefaultCase<C>::value) {
+                    default_idx = i;
+                } else if constexpr (internal::IsDeadlineCase<C>::value) {
+                    deadline_idx = i;
+                    tp = c.tp;
+                }
+            },
+            seq);
+    }
+
+    internal::Selector selector;
+    // held by this select while it polls, taken by a counterpart that
+    // completes one of its rendezvous
+    std::atomic<bool> claim{false};
+    auto attached = false;
+    auto detach = [&]() {
+        if (!attached)
+            return;
+        attached = false;
+        std::apply(
+            [&](auto &...c) {
+                (
+                    [&](auto &c) {
+                        if constexpr (internal::is_chan_case<
+                                          std::decay_t<decltype(c)>>)
+                            c.detach(&selector);
+                    }(c),
+                    ...);
+            },
+            cs);
+    };
+    goxx_defer(detach);
+
+    auto start = internal::select_start(N);
+    for (;;) {
+        auto fired = select_none;
+        auto live = false;
+        if (attached && claim.exchange(true)) {
+            // a counterpart completed a rendezvous, detaching waits for it
+            // to finish under the chan lock
+            detach();
+            for (size_t i = 0; i < N; i++) {
+                internal::visit_at(
+                    cs, i,
+                    [&](auto &c) {
+                        if constexpr (internal::is_chan_case<
+                                          std::decay_t<decltype(c)>>) {
+                            if (c.handed_off())
+                                fired = i;
+                        }
+                    },
+                    seq);
+            }
+        }
+        for (size_t j = 0; j < N && fired == select_none; j++) {
+            auto i = (start + j) % N;
+            internal::visit_at(
+                cs, i,
+                [&](auto &c) {
+                    if constexpr (internal::is_chan_case<
+                                      std::decay_t<decltype(c)>>) {
+                        if (c.poll()) {
+                            fired = i;
+                        } else if (!c.disabled) {
+                            live = true;
+                        }
+                    }
+                },
+                seq);
+        }
+        if (fired == select_none && default_idx == select_none &&
+            deadline_idx != select_none &&
+            std::chrono::steady_clock::now() >= *tp) {
+            fired = deadline_idx;
+        }
+        if (fired == select_none && default_idx != select_none) {
+            fired = default_idx;
+        }
+        if (fired != select_none) {
+            detach();
+            internal::visit_at(
+                cs, fired,
+                [&](auto &c) {
+                    using C = std::decay_t<decltype(c)>;
+                    if constexpr (internal::is_chan_case<C>) {
+                        c.run();
+                    } else {
+                        c.f();
+                    }
+                },
+                seq);
+            return fired;
+        }
+        if (!live && !tp) {
+            return select_none;
+        }
+        if (!attached) {
+            // poll once more after attaching, a change in between is either
+            // seen by that poll or signals the selector
+            std::apply(
+                [&](auto &...c) {
+                    (
+                        [&](auto &c) {
+                            if constexpr (internal::is_chan_case<
+                                              std::decay_t<decltype(c)>>)
+                                c.attach(&selector, &claim);
+                        }(c),
+                        ...);
+                },
+                cs);
+            attached = true;
+            continue;
+        }
+        claim.store(false);
+        if (tp) {
+            selector.wait_until(*tp);
+        } else {
+            selector.wait();
+        }
+    }
+}
+
+} // namespace goxx
@@ -0,0 +1,45 @@
+#pragma once
+#include "goxx/executor.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace goxx {
+namespace internal {
+/*
+    one parked select, registered on every chan it waits for.
+    a chan signals it on any state change, the select then polls again
+ */
+class Selector {
+  public:
+    void signal();
+
+    // both consume the signal, wait_until returns false on timeout
+    void wait();
+    bool wait_until(std::chrono::steady_clock::time_point tp);
+
+    // parks a coroutine instead of the thread, the next signal submits
+    // resume(arg) to the Executor. false, consuming the signal, when one is
+    // already pending
+    bool park(void (*resume)(void *), void *arg);
+
+  private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool signalled_ = false;
+    void (*resume_)(void *) = nullptr;
+    void *arg_ = nullptr;
+};
+
+// lets select reach the private attach / detach of a chan
+struct ChanAccess {
+    template <class C, class... Args>
+    static void attach(C &c, Selector *s, Args... args);
+    template <class C, class... Args>
+    static void detach(C &c, Selector *s, Args... args);
+};
+
+} // namespace internal
+} // namespace goxx
+
+#include "goxx/selector.ipp"
@@ -0,0 +1,62 @@
+#pragma once
+#include "goxx/selector.hpp"
+#include <utility>
+
+namespace goxx {
+namespace internal {
+
+inline void Selector::signal() {
+    void (*resume)(void *) = nullptr;
+    void *arg = nullptr;
+    {
+        auto lg = std::lock_guard{mtx_};
+        if (resume_) {
+            resume = std::exchange(resume_, nullptr);
+            arg = arg_;
+        } else {
+            signalled_ = true;
+        }
+    }
+    if (resume) {
+        Executor::instance().submit([resume, arg]() { resume(arg); });
+        return;
+    }
+    cv_.notify_one();
+}
+
+inline bool Selector::park(void (*resume)(void *), void *arg) {
+    auto lg = std::lock_guard{mtx_};
+    if (std::exchange(signalled_, false))
+        return false;
+    resume_ = resume;
+    arg_ = arg;
+    return true;
+}
+
+inline void Selector::wait() {
+    Executor::Blocking blocking;
+    auto ul = std::unique_lock{mtx_};
+    cv_.wait(ul, [this]() { return signalled_; });
+    signalled_ = false;
+}
+
+inline bool Selector::wait_until(std::chrono::steady_clock::time_point tp) {
+    Executor::Blocking blocking;
+    auto ul = std::unique_lock{mtx_};
+    auto res = cv_.wait_until(ul, tp, [this]() { return signalled_; });
+    signalled_ = false;
+    return res;
+}
+
+template <class C, class... Args>
+void ChanAccess::attach(C &c, Selector *s, Args... args) {
+    c.attach(s, args...);
+}
+
+template <class C, class... Args>
+void ChanAccess::detach(C &c, Selector *s, Args... args) {
+    c.detach(s, args...);
+}
+
+} // namespace internal
+} // namespace goxx
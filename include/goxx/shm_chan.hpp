@@ -0,0 +1,151 @@
+#pragma once
+
+#include "goxx/padded.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <type_traits>
+
+namespace goxx {
+
+namespace internal {
+// processes attached to one ShmChan at a time
+inline constexpr size_t shm_chan_max_peers = 64;
+// a sleeper wakes up this often to look for dead peers
+inline constexpr std::chrono::milliseconds shm_chan_poll{10};
+
+/*
+    start of the shared segment, the slots follow it. only fixed size types
+    and address free atomics, every process maps it at its own address
+ */
+struct ShmChanHeader {
+    std::atomic<uint64_t> magic; // stored last by the creator
+    uint32_t version;
+    uint32_t value_size;
+    uint64_t size;
+    uint64_t bytes;
+    alignas(cache_line_size) std::atomic<uint64_t> tail;
+    alignas(cache_line_size) std::atomic<uint64_t> head;
+    // futex words, bumped to wake, and how many sleep on them
+    alignas(cache_line_size) std::atomic<uint32_t> readable;
+    std::atomic<uint32_t> writable;
+    std::atomic<uint32_t> readers_waiting;
+    std::atomic<uint32_t> writers_waiting;
+    std::atomic<uint32_t> broken;
+    std::atomic<int32_t> peers[shm_chan_max_peers]; // pids, 0 is free
+};
+} // namespace internal
+
+/*
+        Chan between processes, for trivially copyable T
+
+        lives in a named POSIX shared memory segment ("/name") or, for any
+        other name, in a file mapped into memory. the ring is the one of
+        Chan: lock free, a sequence number per slot, closed bit on tail_.
+        sleeping is a futex on the segment, so a push in one process wakes
+        a pop in another, and only when one sleeps.
+
+        every process attaches with its own ShmChan. the one that creates
+        the segment sets its size, the others pass 0 or the same size:
+
+            ShmChan<Quote> feed{"/feed", 4096};   // feed handler
+            ShmChan<Quote> feed{"/feed", 0};      // strategy
+            for (auto q : feed) { }
+
+        a process that dies attached closes the chan and marks it broken,
+        sleepers look for dead peers every internal::shm_chan_poll. values
+        a dead producer claimed but never published are lost, the pops
+        after them end. the destructor detaches without closing, unlink()
+        removes the name. an attachment is per process, attach again after
+        fork. linux only.
+ */
+template <class T>
+class ShmChan {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "ShmChan copies values as bytes");
+
+  public:
+    // size 0 attaches to an existing chan, spin > 0 polls the ring up to
+    // spin times before sleeping. throws std::system_error when the segment
+    // can not be opened, std::runtime_error when it does not fit T / size
+    ShmChan(const std::string &name, size_t size, size_t spin = 0);
+    ~ShmChan(); // detaches, does not close
+    ShmChan(const ShmChan &) = delete;
+    ShmChan &operator=(const ShmChan &) = delete;
+
+    // false if there was no such name
+    static bool unlink(const std::string &name);
+
+    void close();
+    bool closed();
+    bool broken();    // closed because a peer died
+    bool exhausted(); // closed && nothing left to pop
+    operator bool();  // !exhausted()
+
+    bool push(T t);
+    bool try_push(T t);
+    std::optional<T> pop();
+    std::optional<T> try_pop();
+
+    /***************************************
+         range expression
+          for (auto x : ch) { }
+     ********************************/
+    class Iterator {
+        friend class ShmChan;
+
+      public:
+        bool operator!=(const Iterator &end) const;
+        void operator++();
+        T operator*();
+
+      private:
+        Iterator(ShmChan<T> &);
+        ShmChan<T> &c_;
+        std::optional<T> tmp_;
+    };
+    Iterator begin();
+    Iterator end();
+
+  private:
+    static constexpr uint64_t closed_bit = ~(~uint64_t{0} >> 1);
+    static constexpr uint64_t magic = 0x676f78787368636eull; // goxxshcn
+    static constexpr uint32_t version = 1;
+
+    // same doubled seq as Chan
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    enum class Status { ok, full, empty, closed };
+
+    Status enqueue(const T &t);
+    Status dequeue(std::optional<T> &res);
+    bool ring_full() const;
+    bool ring_empty() const;
+    bool ring_ready() const;
+
+    template <class Pred>
+    void park(std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiting,
+              Pred &&pred);
+    void wake(std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiting,
+              int n);
+    void check_peers();
+
+    void attach(const std::string &name, size_t size);
+
+    internal::ShmChanHeader *hdr_ = nullptr;
+    Slot *slots_ = nullptr;
+    size_t size_ = 0;
+    size_t spin_;
+    std::atomic<int32_t> *peer_ = nullptr; // our entry
+};
+
+} // namespace goxx
+
+#include "goxx/shm_chan.ipp"
@@ -0,0 +1,432 @@
+#pragma once
+
+#include "goxx/defer.hpp"
+#include "goxx/executor.hpp"
+#include "goxx/shm_chan.hpp"
+#include "goxx/spin.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+namespace goxx {
+
+namespace internal {
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "futex words must be plain 32 bit ints");
+
+// not FUTEX_PRIVATE_FLAG, the word is shared between processes.
+// false on timeout
+inline bool futex_wait(std::atomic<uint32_t> &word, uint32_t val,
+                       std::chrono::nanoseconds timeout) {
+    auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec ts{(time_t)s.count(), (long)(timeout - s).count()};
+    auto r = ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word),
+                       FUTEX_WAIT, val, &ts, nullptr, 0);
+    return r == 0 || errno != ETIMEDOUT;
+}
+
+inline void futex_wake(std::atomic<uint32_t> &word, int n) {
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, n,
+              nullptr, nullptr, 0);
+}
+
+// a zombie still takes signals, /proc tells it apart. a reused pid passes
+// for the dead process
+inline bool process_alive(pid_t pid) {
+    if (::kill(pid, 0) != 0 && errno == ESRCH)
+        return false;
+    char path[32];
+    std::snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    auto *f = std::fopen(path, "r");
+    if (!f)
+        return true;
+    char buf[512];
+    auto n = std::fread(buf, 1, sizeof(buf) - 1, f);
+    std::fclose(f);
+    buf[n] = 0;
+    // pid (comm) state ..., comm may hold ')'
+    auto *p = std::strrchr(buf, ')');
+    return !(p && p[1] == ' ' && (p[2] == 'Z' || p[2] == 'X'));
+}
+
+// "/name" is a POSIX shared memory object, anything else a file
+inline bool shm_chan_is_shm(const std::string &name) {
+    return name.size() > 1 && name[0] == '/' &&
+           name.find('/', 1) == std::string::npos;
+}
+
+inline std::system_error shm_chan_error(const std::string &what,
+                                        const std::string &name) {
+    return std::system_error(errno, std::generic_category(),
+                             "ShmChan " + what + " " + name);
+}
+} // namespace internal
+
+template <class T>
+ShmChan<T>::ShmChan(const std::string &name, size_t size, size_t spin)
+    : spin_(spin) {
+    attach(name, size);
+}
+
+/*
+    O_EXCL picks the creator, it sizes the segment, builds the header and
+    the slots and stores magic last. the others wait for the size, then for
+    magic, and check that the layout is the one they expect
+ */
+template <class T>
+void ShmChan<T>::attach(const std::string &name, size_t size) {
+    using Clock = std::chrono::steady_clock;
+    auto shm = internal::shm_chan_is_shm(name);
+    auto open_fd = [&](int flags) {
+        return shm ? ::shm_open(name.c_str(), flags, 0600)
+                   : ::open(name.c_str(), flags | O_CLOEXEC, 0600);
+    };
+    auto slots_at = (sizeof(internal::ShmChanHeader) + alignof(Slot) - 1) /
+                    alignof(Slot) * alignof(Slot);
+    auto created = false;
+    auto fd = -1;
+    if (size > 0) {
+        fd = open_fd(O_RDWR | O_CREAT | O_EXCL);
+        if (fd >= 0) {
+            created = true;
+        } else if (errno != EEXIST) {
+            throw internal::shm_chan_error("open", name);
+        }
+    }
+    if (fd < 0 && (fd = open_fd(O_RDWR)) < 0)
+        throw internal::shm_chan_error("open", name);
+    goxx_defer([fd]() { ::close(fd); });
+
+    auto deadline = Clock::now() + std::chrono::seconds(1);
+    auto not_ready = [&]() {
+        if (Clock::now() > deadline)
+            throw std::runtime_error("ShmChan " + name +
+                                     " never got initialized");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+    size_t bytes;
+    if (created) {
+        bytes = slots_at + size * sizeof(Slot);
+        if (::ftruncate(fd, (off_t)bytes) != 0) {
+            auto err = internal::shm_chan_error("ftruncate", name);
+            unlink(name);
+            throw err;
+        }
+    } else {
+        for (;;) {
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+                throw internal::shm_chan_error("fstat", name);
+            bytes = (size_t)st.st_size;
+            if (bytes >= slots_at)
+                break;
+            not_ready();
+        }
+    }
+    auto *mem =
+        ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+        throw internal::shm_chan_error("mmap", name);
+    auto mapped = true;
+    goxx_defer([&]() {
+        if (mapped)
+            ::munmap(mem, bytes);
+    });
+    hdr_ = static_cast<internal::ShmChanHeader *>(mem);
+    slots_ = reinterpret_cast<Slot *>(static_cast<char *>(mem) + slots_at);
+    if (created) {
+        new (hdr_) internal::ShmChanHeader{};
+        hdr_->version = version;
+        hdr_->value_size = sizeof(T);
+        hdr_->size = size;
+        hdr_->bytes = bytes;
+        for (size_t i = 0; i < size; i++) {
+            new (&slots_[i]) Slot;
+            slots_[i].seq.store(2 * i, std::memory_order_relaxed);
+        }
+        hdr_->magic.store(magic, std::memory_order_release);
+    } else {
+        while (hdr_->magic.load(std::memory_order_acquire) != magic) {
+            not_ready();
+        }
+        if (hdr_->version != version || hdr_->value_size != sizeof(T) ||
+            hdr_->bytes != bytes || (size > 0 && hdr_->size != size))
+            throw std::runtime_error("ShmChan " + name +
+                                     " holds another layout");
+    }
+    size_ = hdr_->size;
+    auto pid = (int32_t)::getpid();
+    for (auto &p : hdr_->peers) {
+        int32_t free = 0;
+        if (p.compare_exchange_strong(free, pid)) {
+            peer_ = &p;
+            break;
+        }
+    }
+    if (!peer_)
+        throw std::runtime_error("ShmChan " + name +
+                                 " has too many processes attached");
+    mapped = false;
+}
+
+template <class T>
+ShmChan<T>::~ShmChan() {
+    peer_->store(0, std::memory_order_release);
+    ::munmap(hdr_, hdr_->bytes);
+}
+
+template <class T>
+bool ShmChan<T>::unlink(const std::string &name) {
+    if (internal::shm_chan_is_shm(name))
+        return ::shm_unlink(name.c_str()) == 0;
+    return ::unlink(name.c_str()) == 0;
+}
+
+template <class T>
+void ShmChan<T>::close() {
+    hdr_->tail.fetch_or(closed_bit, std::memory_order_seq_cst);
+    wake(hdr_->readable, hdr_->readers_waiting, INT_MAX);
+    wake(hdr_->writable, hdr_->writers_waiting, INT_MAX);
+}
+
+template <class T>
+bool ShmChan<T>::closed() {
+    return hdr_->tail.load(std::memory_order_acquire) & closed_bit;
+}
+
+template <class T>
+bool ShmChan<T>::broken() {
+    return hdr_->broken.load(std::memory_order_acquire);
+}
+
+template <class T>
+bool ShmChan<T>::exhausted() {
+    return closed() && (ring_empty() || (broken() && !ring_ready()));
+}
+
+template <class T>
+ShmChan<T>::operator bool() {
+    return !exhausted();
+}
+
+template <class T>
+bool ShmChan<T>::push(T t) {
+    for (;;) {
+        switch (enqueue(t)) {
+        case Status::ok:
+            wake(hdr_->readable, hdr_->readers_waiting, 1);
+            return true;
+        case Status::closed:
+            return false;
+        default:
+            park(hdr_->writable, hdr_->writers_waiting,
+                 [&]() { return closed() || !ring_full(); });
+        }
+    }
+}
+
+template <class T>
+bool ShmChan<T>::try_push(T t) {
+    if (enqueue(t) != Status::ok)
+        return false;
+    wake(hdr_->readable, hdr_->readers_waiting, 1);
+    return true;
+}
+
+template <class T>
+std::optional<T> ShmChan<T>::pop() {
+    std::optional<T> res;
+    for (;;) {
+        if (dequeue(res) == Status::ok) {
+            wake(hdr_->writable, hdr_->writers_waiting, 1);
+            return res;
+        }
+        if (exhausted())
+            return std::nullopt;
+        // after close, a producer still has to publish the slot it claimed,
+        // or to be found dead
+        park(hdr_->readable, hdr_->readers_waiting, [&]() {
+            return ring_ready() || (closed() && (ring_empty() || broken()));
+        });
+    }
+}
+
+template <class T>
+std::optional<T> ShmChan<T>::try_pop() {
+    std::optional<T> res;
+    if (dequeue(res) == Status::ok)
+        wake(hdr_->writable, hdr_->writers_waiting, 1);
+    return res;
+}
+
+template <class T>
+typename ShmChan<T>::Status ShmChan<T>::enqueue(const T &t) {
+    auto &tail = hdr_->tail;
+    auto pos = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        if (pos & closed_bit)
+            return Status::closed;
+        slot = &slots_[pos % size_];
+        auto seq = slot->seq.load(std::memory_order_acquire);
+        auto dif = (std::ptrdiff_t)(seq - 2 * pos);
+        if (dif == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return Status::full;
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    std::memcpy(slot->storage, &t, sizeof(T));
+    slot->seq.store(2 * pos + 1, std::memory_order_release);
+    return Status::ok;
+}
+
+template <class T>
+typename ShmChan<T>::Status ShmChan<T>::dequeue(std::optional<T> &res) {
+    auto &head = hdr_->head;
+    auto pos = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        slot = &slots_[pos % size_];
+        auto seq = slot->seq.load(std::memory_order_acquire);
+        auto dif = (std::ptrdiff_t)(seq - (2 * pos + 1));
+        if (dif == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return Status::empty;
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    res.emplace(*std::launder(reinterpret_cast<T *>(slot->storage)));
+    slot->seq.store(2 * (pos + size_), std::memory_order_release);
+    return Status::ok;
+}
+
+template <class T>
+bool ShmChan<T>::ring_full() const {
+    auto pos = hdr_->tail.load(std::memory_order_seq_cst) & ~closed_bit;
+    auto seq = slots_[pos % size_].seq.load(std::memory_order_seq_cst);
+    return (std::ptrdiff_t)(seq - 2 * pos) < 0;
+}
+
+template <class T>
+bool ShmChan<T>::ring_empty() const {
+    return hdr_->head.load(std::memory_order_seq_cst) ==
+           (hdr_->tail.load(std::memory_order_seq_cst) & ~closed_bit);
+}
+
+template <class T>
+bool ShmChan<T>::ring_ready() const {
+    auto pos = hdr_->head.load(std::memory_order_seq_cst);
+    auto seq = slots_[pos % size_].seq.load(std::memory_order_seq_cst);
+    return (std::ptrdiff_t)(seq - (2 * pos + 1)) >= 0;
+}
+
+/*
+    like Chan::park with a futex for the condition variable. waiting is
+    raised before pred is checked, wake() reads it after publishing, and
+    the word read before pred makes a bump in between fail the futex wait
+ */
+template <class T>
+template <class Pred>
+void ShmChan<T>::park(std::atomic<uint32_t> &word,
+                      std::atomic<uint32_t> &waiting, Pred &&pred) {
+    for (size_t i = 0; i < spin_; i++) {
+        if (pred())
+            return;
+        cpu_relax();
+    }
+    Executor::Blocking blocking;
+    for (;;) {
+        auto w = word.load(std::memory_order_acquire);
+        waiting.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (pred()) {
+            waiting.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+        auto woken = internal::futex_wait(word, w, internal::shm_chan_poll);
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+        if (pred())
+            return;
+        if (!woken)
+            check_peers();
+    }
+}
+
+template <class T>
+void ShmChan<T>::wake(std::atomic<uint32_t> &word,
+                      std::atomic<uint32_t> &waiting, int n) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) == 0)
+        return;
+    word.fetch_add(1, std::memory_order_release);
+    internal::futex_wake(word, n);
+}
+
+// the first to clear a dead peer's entry closes the chan
+template <class T>
+void ShmChan<T>::check_peers() {
+    for (auto &p : hdr_->peers) {
+        auto pid = p.load(std::memory_order_acquire);
+        if (pid == 0 || internal::process_alive(pid))
+            continue;
+        if (p.compare_exchange_strong(pid, 0)) {
+            hdr_->broken.store(1, std::memory_order_release);
+            close();
+        }
+    }
+}
+
+template <class T>
+ShmChan<T>::Iterator::Iterator(ShmChan<T> &c) : c_(c) {}
+
+template <class T>
+bool ShmChan<T>::Iterator::operator!=(const Iterator &) const {
+    return tmp_.has_value();
+}
+
+template <class T>
+void ShmChan<T>::Iterator::operator++() {
+    tmp_ = c_.pop();
+}
+
+template <class T>
+T ShmChan<T>::Iterator::operator*() {
+    return *tmp_;
+}
+
+template <class T>
+typename ShmChan<T>::Iterator ShmChan<T>::begin() {
+    Iterator res{*this};
+    res.tmp_ = pop();
+    return res;
+}
+
+template <class T>
+typename ShmChan<T>::Iterator ShmChan<T>::end() {
+    return Iterator{*this};
+}
+
+} // namespace goxx
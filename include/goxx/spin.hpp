@@ -0,0 +1,14 @@
+#pragma once
+
+namespace goxx {
+
+// pause hint for spin loops, keeps a hyperthread sibling going
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace goxx
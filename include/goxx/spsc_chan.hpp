@@ -0,0 +1,95 @@
+
+#pragma once
+
+#include "goxx/executor.hpp"
+#include "goxx/padded.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace goxx {
+/*
+        single producer single consumer chan
+
+        same interface as Chan, but only one thread may push and only one
+        thread may pop. push / pop are wait free while the ring is neither
+        full nor empty, each side keeps a cached copy of the other side's
+        index and only reads the shared one when the cache says full/empty.
+
+        *NOTE* there is no rendezvous mode, size 0 is treated as size 1.
+        as with go chans, close() should come from the producer side, a push
+        racing a close from a third thread may be dropped.
+ */
+template <class T>
+class SpscChan {
+  public:
+    SpscChan(size_t size);
+
+    ~SpscChan(); // calls close
+
+    void close();
+    bool closed();
+    bool exhausted(); // check ring empty && closed
+    operator bool();  // check !(ring empty && closed)
+
+    bool push(T &&t);
+    bool try_push(T &&t);
+    std::optional<T> pop();
+    std::optional<T> try_pop();
+
+    /***************************************
+         range expression
+          for (auto x : ch) { }
+     ********************************/
+
+    class Iterator {
+        friend class SpscChan;
+
+      public:
+        bool operator!=(const Iterator &end) const;
+        void operator++();
+        T operator*();
+
+      private:
+        Iterator(SpscChan<T> &);
+        SpscChan<T> &c_;
+        std::optional<T> tmp_;
+    };
+    Iterator begin();
+    Iterator end();
+
+  private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        T *value();
+    };
+
+    bool ring_full();  // producer side
+    bool ring_empty(); // consumer side
+    void wait_not_full();
+    void wait_not_empty();
+    void wake(std::atomic<bool> &parked);
+
+    const size_t size_;
+    std::unique_ptr<Slot[]> slots_;
+
+    // producer owned
+    alignas(cache_line_size) std::atomic<size_t> tail_{0};
+    size_t head_cache_ = 0;
+    // consumer owned
+    alignas(cache_line_size) std::atomic<size_t> head_{0};
+    size_t tail_cache_ = 0;
+
+    alignas(cache_line_size) std::atomic<bool> closed_{false};
+    std::atomic<bool> producer_parked_{false};
+    std::atomic<bool> consumer_parked_{false};
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+} // namespace goxx
+
+#include "goxx/spsc_chan.ipp"
\ No newline at end of file
@@ -0,0 +1,201 @@
+
+#pragma once
+
+#include "goxx/spsc_chan.hpp"
+#include <new>
+#include <thread>
+
+namespace goxx {
+
+template <class T>
+SpscChan<T>::SpscChan(size_t size)
+    : size_(size ? size : 1), slots_(new Slot[size_]) {}
+
+template <class T>
+SpscChan<T>::~SpscChan() {
+    close();
+    auto tail = tail_.load(std::memory_order_acquire);
+    for (auto pos = head_.load(std::memory_order_acquire); pos != tail;
+         pos++) {
+        slots_[pos % size_].value()->~T();
+    }
+}
+
+template <class T>
+T *SpscChan<T>::Slot::value() {
+    return std::launder(reinterpret_cast<T *>(storage));
+}
+
+template <class T>
+bool SpscChan<T>::closed() {
+    return closed_.load(std::memory_order_acquire);
+}
+
+template <class T>
+bool SpscChan<T>::exhausted() {
+    return closed() && head_.load(std::memory_order_acquire) ==
+                           tail_.load(std::memory_order_acquire);
+}
+
+template <class T>
+SpscChan<T>::operator bool() {
+    return !exhausted();
+}
+
+template <class T>
+void SpscChan<T>::close() {
+    closed_.store(true, std::memory_order_seq_cst);
+    { auto lg = std::lock_guard{mtx_}; }
+    cv_.notify_all();
+}
+
+template <class T>
+bool SpscChan<T>::ring_full() {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ < size_)
+        return false;
+    head_cache_ = head_.load(std::memory_order_acquire);
+    return tail - head_cache_ >= size_;
+}
+
+template <class T>
+bool SpscChan<T>::ring_empty() {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head != tail_cache_)
+        return false;
+    tail_cache_ = tail_.load(std::memory_order_acquire);
+    return head == tail_cache_;
+}
+
+template <class T>
+bool SpscChan<T>::push(T &&t) {
+    for (;;) {
+        if (closed())
+            return false;
+        if (!ring_full())
+            break;
+        wait_not_full();
+    }
+    auto tail = tail_.load(std::memory_order_relaxed);
+    new (slots_[tail % size_].storage) T(std::move(t));
+    tail_.store(tail + 1, std::memory_order_release);
+    wake(consumer_parked_);
+    return true;
+}
+
+template <class T>
+bool SpscChan<T>::try_push(T &&t) {
+    if (closed() || ring_full())
+        return false;
+    auto tail = tail_.load(std::memory_order_relaxed);
+    new (slots_[tail % size_].storage) T(std::move(t));
+    tail_.store(tail + 1, std::memory_order_release);
+    wake(consumer_parked_);
+    return true;
+}
+
+template <class T>
+std::optional<T> SpscChan<T>::pop() {
+    for (;;) {
+        if (!ring_empty())
+            break;
+        if (closed()) {
+            // the last push may have landed right before close
+            if (ring_empty())
+                return std::nullopt;
+            break;
+        }
+        wait_not_empty();
+    }
+    return try_pop();
+}
+
+template <class T>
+std::optional<T> SpscChan<T>::try_pop() {
+    if (ring_empty())
+        return std::nullopt;
+    auto head = head_.load(std::memory_order_relaxed);
+    auto value = slots_[head % size_].value();
+    std::optional<T> res{std::move(*value)};
+    value->~T();
+    head_.store(head + 1, std::memory_order_release);
+    wake(producer_parked_);
+    return res;
+}
+
+/*
+    slow paths, the parked flag is raised before the ring is checked again
+    and wake() reads it after publishing, so one side always sees the other
+ */
+template <class T>
+void SpscChan<T>::wait_not_full() {
+    for (auto i = 0; i < 64; i++) {
+        if (closed() || !ring_full())
+            return;
+        std::this_thread::yield();
+    }
+    Executor::Blocking blocking;
+    auto ul = std::unique_lock{mtx_};
+    producer_parked_.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_.wait(ul, [this]() { return closed() || !ring_full(); });
+    producer_parked_.store(false, std::memory_order_relaxed);
+}
+
+template <class T>
+void SpscChan<T>::wait_not_empty() {
+    for (auto i = 0; i < 64; i++) {
+        if (closed() || !ring_empty())
+            return;
+        std::this_thread::yield();
+    }
+    Executor::Blocking blocking;
+    auto ul = std::unique_lock{mtx_};
+    consumer_parked_.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_.wait(ul, [this]() { return closed() || !ring_empty(); });
+    consumer_parked_.store(false, std::memory_order_relaxed);
+}
+
+template <class T>
+void SpscChan<T>::wake(std::atomic<bool> &parked) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!parked.load(std::memory_order_relaxed))
+        return;
+    { auto lg = std::lock_guard{mtx_}; }
+    cv_.notify_all();
+}
+
+/* range expression */
+
+template <class T>
+typename SpscChan<T>::Iterator SpscChan<T>::begin() {
+    Iterator res{*this};
+    res.tmp_ = pop();
+    return res;
+}
+
+template <class T>
+bool SpscChan<T>::Iterator::operator!=(const SpscChan<T>::Iterator &) const {
+    return tmp_.has_value();
+}
+
+template <class T>
+T SpscChan<T>::Iterator::operator*() {
+    return std::move(*tmp_);
+}
+
+template <class T>
+void SpscChan<T>::Iterator::operator++() {
+    tmp_ = c_.pop();
+}
+
+template <class T>
+SpscChan<T>::Iterator::Iterator(SpscChan<T> &c) : c_(c) {}
+
+template <class T>
+typename SpscChan<T>::Iterator SpscChan<T>::end() {
+    return Iterator{*this};
+}
+
+} // namespace goxx
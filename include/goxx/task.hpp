@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+
+namespace goxx {
+
+/*
+    move only void() callable with a small buffer. a callable of up to
+    inline_size bytes that moves without throwing is stored in place,
+    scheduling it allocates nothing. bigger ones go to the heap. unlike
+    std::function it takes move only captures such as a unique_ptr
+ */
+class Task {
+  public:
+    static constexpr size_t inline_size = 48;
+
+    Task() noexcept = default;
+
+    template <class F,
+              class = std::enable_if_t<
+                  !std::is_same_v<std::decay_t<F>, Task> &&
+                  std::is_invocable_r_v<void, std::decay_t<F> &>>>
+    Task(F &&f);
+
+    Task(Task &&other) noexcept;
+    Task &operator=(Task &&other) noexcept;
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task();
+
+    void operator()();
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+  private:
+    struct Ops {
+        void (*call)(void *self);
+        // move constructs into dst, destroys src
+        void (*relocate)(void *dst, void *src) noexcept;
+        void (*destroy)(void *self) noexcept;
+    };
+
+    template <class F>
+    static constexpr bool fits_inline =
+        sizeof(F) <= inline_size && alignof(F) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible_v<F>;
+
+    template <class F>
+    static const Ops inline_ops;
+    template <class F>
+    static const Ops heap_ops;
+
+    void reset() noexcept;
+
+    alignas(std::max_align_t) unsigned char buf_[inline_size];
+    const Ops *ops_ = nullptr;
+};
+
+} // namespace goxx
+
+#include "goxx/task.ipp"
@@ -0,0 +1,70 @@
+#pragma once
+#include "goxx/task.hpp"
+#include <new>
+#include <utility>
+
+namespace goxx {
+
+template <class F>
+const Task::Ops Task::inline_ops = {
+    [](void *self) { (*static_cast<F *>(self))(); },
+    [](void *dst, void *src) noexcept {
+        ::new (dst) F(std::move(*static_cast<F *>(src)));
+        static_cast<F *>(src)->~F();
+    },
+    [](void *self) noexcept { static_cast<F *>(self)->~F(); },
+};
+
+// buf_ holds an F *
+template <class F>
+const Task::Ops Task::heap_ops = {
+    [](void *self) { (**static_cast<F **>(self))(); },
+    [](void *dst, void *src) noexcept {
+        ::new (dst) F *(*static_cast<F **>(src));
+    },
+    [](void *self) noexcept { delete *static_cast<F **>(self); },
+};
+
+template <class F, class>
+Task::Task(F &&f) {
+    using D = std::decay_t<F>;
+    if constexpr (fits_inline<D>) {
+        ::new ((void *)buf_) D(std::forward<F>(f));
+        ops_ = &inline_ops<D>;
+    } else {
+        ::new ((void *)buf_) D *(new D(std::forward<F>(f)));
+        ops_ = &heap_ops<D>;
+    }
+}
+
+inline Task::Task(Task &&other) noexcept : ops_{other.ops_} {
+    if (ops_) {
+        ops_->relocate(buf_, other.buf_);
+        other.ops_ = nullptr;
+    }
+}
+
+inline Task &Task::operator=(Task &&other) noexcept {
+    if (this != &other) {
+        reset();
+        if (other.ops_) {
+            other.ops_->relocate(buf_, other.buf_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+    return *this;
+}
+
+inline Task::~Task() { reset(); }
+
+inline void Task::operator()() { ops_->call(buf_); }
+
+inline void Task::reset() noexcept {
+    if (ops_) {
+        ops_->destroy(buf_);
+        ops_ = nullptr;
+    }
+}
+
+} // namespace goxx
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+    timers on one background thread, go's time.After / AfterFunc / Ticker
+
+        auto timeout = goxx::after(50ms);
+        Ticker tick{1s};
+        for (;;) {
+            // select on tick.chan() and *timeout
+        }
+
+    a hierarchical timer wheel: 6 levels of 64 slots, a slot is an intrusive
+    list, so adding and stopping a timer are O(1) whatever the number of
+    pending timers. the level 0 slot of tick t holds the timers due in it,
+    a slot of level l holds 64^l ticks and moves its timers a level down
+    when the levels below it wrap around. the thread sleeps until the next
+    tick with a timer in level 0 or the next wrap around, never longer
+    without timers.
+
+    a timer fires on the first tick at or after its deadline, so at most
+    one tick plus a thread wake up late. the tick is the tolerance, set it
+    with GOXX_TIMER_TICK_US (microseconds, default 1000).
+
+    like go's, timer chans hold one value and a tick that finds it full is
+    dropped.
+ */
+#ifndef GOXX_TIMER_TICK_US
+#define GOXX_TIMER_TICK_US 1000
+#endif
+
+namespace goxx {
+
+template <class T>
+class Chan;
+
+using TimerClock = std::chrono::steady_clock;
+
+namespace internal {
+struct TimerLink {
+    TimerLink *prev = nullptr;
+    TimerLink *next = nullptr;
+};
+
+struct TimerNode : TimerLink {
+    TimerLink *slot = nullptr; // head of its list while pending
+    uint64_t tick = 0;
+    TimerClock::time_point when;
+    TimerClock::duration period{0}; // 0 fires once
+    std::function<void(TimerClock::time_point)> fire;
+    bool owned_by_wheel = false; // freed once fired, after()
+};
+
+class TimerWheel {
+  public:
+    static TimerWheel &instance();
+    ~TimerWheel(); // drops the pending timers, instance() is never freed
+
+    void add(TimerNode *n, TimerClock::time_point when);
+    bool remove(TimerNode *n); // false unless n was pending
+    // remove n, then add it again when period > 0
+    bool rearm(TimerNode *n, TimerClock::duration d,
+               TimerClock::duration period);
+
+  private:
+    static constexpr unsigned bits = 6;
+    static constexpr unsigned slots = 1u << bits;
+    static constexpr unsigned levels = 6;
+
+    TimerWheel();
+    void run();
+    uint64_t tick_of(TimerClock::time_point t) const; // rounds up
+    void schedule(TimerNode *n, TimerClock::time_point when);
+    void insert(TimerNode *n, uint64_t earliest); // due no sooner
+    void unlink(TimerNode *n);
+    void advance(); // one tick
+    uint64_t next_wake() const;
+
+    const TimerClock::duration tick_;
+    const TimerClock::time_point epoch_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    TimerLink wheel_[levels][slots];
+    uint64_t occupied_ = 0; // non empty level 0 slots
+    uint64_t now_ = 0;      // last tick run
+    uint64_t wake_ = 0;     // tick the thread sleeps until
+    size_t pending_ = 0;
+    bool stop_ = false;
+    std::thread thread_;
+};
+} // namespace internal
+
+// a chan getting the time once d is over
+std::shared_ptr<Chan<TimerClock::time_point>> after(TimerClock::duration d);
+
+class Timer {
+  public:
+    // pushes the time it fired at into chan()
+    explicit Timer(TimerClock::duration d);
+    // f() runs as a task on the Executor, chan() stays empty
+    template <class F>
+    Timer(TimerClock::duration d, F f);
+    ~Timer(); // stops
+
+    Timer(Timer &&) = default;
+    Timer &operator=(Timer &&other);
+
+    bool stop(); // false if it had fired or been stopped already
+    // fires again d from now, returns what stop() would have
+    bool reset(TimerClock::duration d);
+    Chan<TimerClock::time_point> &chan();
+
+  private:
+    std::shared_ptr<Chan<TimerClock::time_point>> c_;
+    std::unique_ptr<internal::TimerNode> node_;
+};
+
+class Ticker {
+  public:
+    explicit Ticker(TimerClock::duration period); // period > 0
+    ~Ticker(); // stops
+
+    Ticker(Ticker &&) = default;
+    Ticker &operator=(Ticker &&other);
+
+    void stop();
+    // the next tick comes one period from now
+    void reset(TimerClock::duration period);
+    Chan<TimerClock::time_point> &chan();
+
+  private:
+    std::shared_ptr<Chan<TimerClock::time_point>> c_;
+    std::unique_ptr<internal::TimerNode> node_;
+};
+
+} // namespace goxx
+
+#include "goxx/timer.ipp"
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "goxx/chan.hpp"
+#include "goxx/executor.hpp"
+#include "goxx/timer.hpp"
+#include <algorithm>
+#include <climits>
+#include <utility>
+
+namespace goxx {
+
+namespace internal {
+// never freed, like the Executor, timers still fire during exit
+inline TimerWheel &TimerWheel::instance() {
+    static auto *wheel = new TimerWheel;
+    return *wheel;
+}
+
+inline TimerWheel::TimerWheel()
+    : tick_(std::chrono::microseconds(GOXX_TIMER_TICK_US)),
+      epoch_(TimerClock::now()) {
+    for (auto &level : wheel_) {
+        for (auto &slot : level) {
+            slot.prev = slot.next = &slot;
+        }
+    }
+    thread_ = std::thread([this]() { run(); });
+}
+
+inline TimerWheel::~TimerWheel() {
+    {
+        auto lg = std::lock_guard{mtx_};
+        stop_ = true;
+        for (auto &level : wheel_) {
+            for (auto &slot : level) {
+                while (slot.next != &slot) {
+                    auto *n = static_cast<TimerNode *>(slot.next);
+                    unlink(n);
+                    if (n->owned_by_wheel)
+                        delete n;
+                }
+            }
+        }
+    }
+    cv_.notify_one();
+    thread_.join();
+}
+
+inline uint64_t TimerWheel::tick_of(TimerClock::time_point t) const {
+    if (t <= epoch_)
+        return 0;
+    return (uint64_t)((t - epoch_ + tick_ - TimerClock::duration(1)) /
+                      tick_);
+}
+
+/*
+    level l takes the timers due in less than 64^(l+1) ticks, in the slot of
+    bits [6l, 6l + 6) of their tick. the lower levels wrap around before the
+    slot comes up, so its timers move down in time. further than the top
+    level can see goes to its farthest slot and comes back later. a new
+    timer due at the latest tick run goes to the next one
+ */
+inline void TimerWheel::insert(TimerNode *n, uint64_t earliest) {
+    auto tick = std::max(n->tick, earliest);
+    auto delta = tick - now_;
+    unsigned l = 0;
+    while (l + 1 < levels && delta >= (uint64_t{1} << (bits * (l + 1)))) {
+        l++;
+    }
+    if (delta >= (uint64_t{1} << (bits * levels)))
+        tick = now_ + (uint64_t{1} << (bits * levels)) - 1;
+    auto idx = (tick >> (bits * l)) & (slots - 1);
+    auto &head = wheel_[l][idx];
+    n->slot = &head;
+    n->prev = head.prev;
+    n->next = &head;
+    head.prev->next = n;
+    head.prev = n;
+    if (l == 0)
+        occupied_ |= uint64_t{1} << idx;
+    pending_++;
+}
+
+inline void TimerWheel::unlink(TimerNode *n) {
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    auto *head = std::exchange(n->slot, nullptr);
+    auto idx = head - &wheel_[0][0];
+    if (head->next == head && idx >= 0 && idx < slots)
+        occupied_ &= ~(uint64_t{1} << idx);
+    pending_--;
+}
+
+/*
+    mtx_ held. an idle wheel stopped counting ticks, it catches up with the
+    clock first, so the thread never runs the ticks it slept through
+ */
+inline void TimerWheel::schedule(TimerNode *n, TimerClock::time_point when) {
+    if (pending_ == 0) {
+        auto current = (uint64_t)((TimerClock::now() - epoch_) / tick_);
+        now_ = std::max(now_, current);
+    }
+    n->when = when;
+    n->tick = tick_of(when);
+    auto wake = pending_ == 0 || n->tick < wake_;
+    insert(n, now_ + 1);
+    if (wake)
+        cv_.notify_one();
+}
+
+inline void TimerWheel::add(TimerNode *n, TimerClock::time_point when) {
+    auto lg = std::lock_guard{mtx_};
+    schedule(n, when);
+}
+
+inline bool TimerWheel::remove(TimerNode *n) {
+    auto lg = std::lock_guard{mtx_};
+    if (!n->slot)
+        return false;
+    unlink(n);
+    return true;
+}
+
+inline bool TimerWheel::rearm(TimerNode *n, TimerClock::duration d,
+                              TimerClock::duration period) {
+    auto lg = std::lock_guard{mtx_};
+    auto pending = n->slot != nullptr;
+    if (pending)
+        unlink(n);
+    n->period = period;
+    schedule(n, TimerClock::now() + d);
+    return pending;
+}
+
+/*
+    cascade first: the level l slot coming up moves down as soon as the
+    levels below it wrap around, then the level 0 slot of the tick fires.
+    a periodic timer goes back in for its next deadline, skipping the ones
+    already missed
+ */
+inline void TimerWheel::advance() {
+    now_++;
+    for (unsigned l = 1; l < levels; l++) {
+        if (now_ & ((uint64_t{1} << (bits * l)) - 1))
+            break;
+        auto &head = wheel_[l][(now_ >> (bits * l)) & (slots - 1)];
+        while (head.next != &head) {
+            auto *n = static_cast<TimerNode *>(head.next);
+            unlink(n);
+            insert(n, now_);
+        }
+    }
+    auto &head = wheel_[0][now_ & (slots - 1)];
+    if (head.next == &head)
+        return;
+    auto now = TimerClock::now();
+    while (head.next != &head) {
+        auto *n = static_cast<TimerNode *>(head.next);
+        unlink(n);
+        n->fire(now);
+        if (n->period.count() > 0) {
+            n->when += n->period;
+            if (n->when <= now) {
+                auto missed = (now - n->when) / n->period;
+                n->when += (missed + 1) * n->period;
+            }
+            n->tick = tick_of(n->when);
+            insert(n, now_ + 1);
+        } else if (n->owned_by_wheel) {
+            delete n;
+        }
+    }
+}
+
+// the next tick with a level 0 timer in this turn of level 0, else the
+// wrap around
+inline uint64_t TimerWheel::next_wake() const {
+    auto idx = now_ & (slots - 1);
+    auto ahead =
+        idx + 1 < slots ? occupied_ & (~uint64_t{0} << (idx + 1)) : 0;
+    if (ahead)
+        return (now_ & ~uint64_t{slots - 1}) + __builtin_ctzll(ahead);
+    return (now_ | (slots - 1)) + 1;
+}
+
+inline void TimerWheel::run() {
+    auto ul = std::unique_lock{mtx_};
+    while (!stop_) {
+        auto current = (uint64_t)((TimerClock::now() - epoch_) / tick_);
+        if (pending_ == 0) {
+            now_ = std::max(now_, current);
+            wake_ = UINT64_MAX;
+            cv_.wait(ul, [&]() { return stop_ || pending_ > 0; });
+            continue;
+        }
+        while (now_ < current && pending_ > 0) {
+            advance();
+        }
+        if (pending_ == 0)
+            continue;
+        wake_ = next_wake();
+        cv_.wait_until(ul, epoch_ + wake_ * tick_);
+    }
+}
+} // namespace internal
+
+inline std::shared_ptr<Chan<TimerClock::time_point>>
+after(TimerClock::duration d) {
+    auto c = std::make_shared<Chan<TimerClock::time_point>>(1);
+    auto *n = new internal::TimerNode{};
+    n->owned_by_wheel = true;
+    n->fire = [c](TimerClock::time_point t) { c->try_push(std::move(t)); };
+    internal::TimerWheel::instance().add(n, TimerClock::now() + d);
+    return c;
+}
+
+inline Timer::Timer(TimerClock::duration d)
+    : c_(std::make_shared<Chan<TimerClock::time_point>>(1)),
+      node_(std::make_unique<internal::TimerNode>()) {
+    node_->fire = [c = c_.get()](TimerClock::time_point t) {
+        c->try_push(std::move(t));
+    };
+    internal::TimerWheel::instance().add(node_.get(), TimerClock::now() + d);
+}
+
+template <class F>
+Timer::Timer(TimerClock::duration d, F f)
+    : node_(std::make_unique<internal::TimerNode>()) {
+    node_->fire = [f = std::make_shared<F>(std::move(f))](
+                      TimerClock::time_point) {
+        Executor::instance().submit([f]() { (*f)(); });
+    };
+    internal::TimerWheel::instance().add(node_.get(), TimerClock::now() + d);
+}
+
+inline Timer::~Timer() {
+    if (node_)
+        stop();
+}
+
+inline Timer &Timer::operator=(Timer &&other) {
+    if (this != &other) {
+        if (node_)
+            stop();
+        c_ = std::move(other.c_);
+        node_ = std::move(other.node_);
+    }
+    return *this;
+}
+
+inline bool Timer::stop() {
+    return internal::TimerWheel::instance().remove(node_.get());
+}
+
+inline bool Timer::reset(TimerClock::duration d) {
+    return internal::TimerWheel::instance().rearm(node_.get(), d,
+                                                 TimerClock::duration(0));
+}
+
+// a Timer running f makes its chan on demand, nothing ever goes in
+inline Chan<TimerClock::time_point> &Timer::chan() {
+    if (!c_)
+        c_ = std::make_shared<Chan<TimerClock::time_point>>(1);
+    return *c_;
+}
+
+inline Ticker::Ticker(TimerClock::duration period)
+    : c_(std::make_shared<Chan<TimerClock::time_point>>(1)),
+      node_(std::make_unique<internal::TimerNode>()) {
+    node_->period = period;
+    node_->fire = [c = c_.get()](TimerClock::time_point t) {
+        c->try_push(std::move(t));
+    };
+    internal::TimerWheel::instance().add(node_.get(),
+                                         TimerClock::now() + period);
+}
+
+inline Ticker::~Ticker() {
+    if (node_)
+        stop();
+}
+
+inline Ticker &Ticker::operator=(Ticker &&other) {
+    if (this != &other) {
+        if (node_)
+            stop();
+        c_ = std::move(other.c_);
+        node_ = std::move(other.node_);
+    }
+    return *this;
+}
+
+inline void Ticker::stop() {
+    internal::TimerWheel::instance().remove(node_.get());
+}
+
+inline void Ticker::reset(TimerClock::duration period) {
+    internal::TimerWheel::instance().rearm(node_.get(), period, period);
+}
+
+inline Chan<TimerClock::time_point> &Ticker::chan() { return *c_; }
+
+} // namespace goxx
@@ -1,12 +1,36 @@
 #pragma once
 
+#include "goxx/context.hpp"
+#include "goxx/executor.hpp"
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 namespace goxx {
+namespace internal {
+struct WaitGroupAwaiter;
+
+// what the nt tasks of one together() share
+template <class F, class Final>
+struct TogetherState {
+    template <class A, class B>
+    TogetherState(A &&f, B &&final, size_t nt)
+        : f(std::forward<A>(f)), final(std::forward<B>(final)), nt(nt),
+          left(nt) {}
+
+    F f;
+    Final final;
+    size_t nt;
+    std::atomic<size_t> left;
+};
+} // namespace internal
+
 /*
     GO style wait group
  */
@@ -19,18 +43,37 @@ class WaitGroup {
 
     void done();
 
-    void go(std::function<void()> &&f);
+    // Launch::pool runs f on the shared Executor, Launch::dedicated on a
+    // thread of its own. f may be move only
+    template <class F>
+    void go(F &&f, Launch launch = Launch::pool);
+    // f is skipped if ctx is cancelled before it starts, it still counts
+    template <class F>
+    void go(F &&f, const Context &ctx, Launch launch = Launch::pool);
 
-    void
-    together(std::function<void(size_t thread_idx, size_t num_threads)> &&f,
-             std::function<void()> &&final = nullptr,
-             size_t nt = std::thread::hardware_concurrency());
+    // f(thread_idx, num_threads) on nt tasks. final runs once, right after
+    // the last of the nt calls of f returns, nullptr for none. both may be
+    // move only
+    template <class F, class Final = std::nullptr_t>
+    void together(F &&f, Final &&final = nullptr,
+                  size_t nt = std::thread::hardware_concurrency(),
+                  Launch launch = Launch::pool);
     void wait();
+    // false as soon as ctx is cancelled, the tasks keep running and
+    // the destructor still waits for them
+    bool wait(const Context &ctx);
 
   private:
+    friend struct internal::WaitGroupAwaiter;
+
+    // queues t for the Executor once the count drops to 0, false if it is
+    // 0 already
+    bool on_done(Task &&t);
+
     size_t count_ = 0;
     std::mutex mtx_;
     std::condition_variable cv_;
+    std::vector<Task> waiters_; // parked coroutines
 };
 
 } // namespace goxx
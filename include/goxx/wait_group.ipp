@@ -15,17 +15,37 @@ void WaitGroup::add(size_t n) {
 }
 
 void WaitGroup::done() {
+    std::vector<Task> waiters;
     {
+        // notify under the lock, a waiter may destroy the group once
+        // count_ hits 0
         std::unique_lock<std::mutex> _(mtx_);
         if (count_ > 0) {
             --count_;
         }
+        if (count_ == 0) {
+            waiters.swap(waiters_);
+        }
+        cv_.notify_all();
+    }
+    for (auto &t : waiters) {
+        Executor::instance().submit(std::move(t));
+    }
+}
+
+bool WaitGroup::on_done(Task &&t) {
+    std::unique_lock<std::mutex> _(mtx_);
+    if (count_ <= 0) {
+        return false;
     }
-    cv_.notify_all();
+    waiters_.push_back(std::move(t));
+    return true;
 }
-void WaitGroup::go(std::function<void()> &&f) {
+template <class F>
+void WaitGroup::go(F &&f, Launch launch) {
     add();
-    std::thread([this, f] {
+    // one Task around f and the done() call, in place when f is small
+    Task task{[this, f = std::forward<F>(f)]() mutable {
         try {
             f();
             done();
@@ -33,29 +53,93 @@ void WaitGroup::go(std::function<void()> &&f) {
             done();
             throw;
         }
-    }).detach();
+    }};
+    if (launch == Launch::dedicated) {
+        std::thread(std::move(task)).detach();
+    } else {
+        Executor::instance().submit(std::move(task));
+    }
+}
+
+template <class F>
+void WaitGroup::go(F &&f, const Context &ctx, Launch launch) {
+    go(
+        [ctx, f = std::forward<F>(f)]() mutable {
+            if (!ctx.cancelled())
+                f();
+        },
+        launch);
 }
 
-void WaitGroup::together(
-    std::function<void(size_t thread_idx, size_t num_threads)> &&f,
-    std::function<void()> &&final, size_t nt) {
-    if (!final) {
+template <class F, class Final>
+void WaitGroup::together(F &&f, Final &&final, size_t nt, Launch launch) {
+    using State =
+        internal::TogetherState<std::decay_t<F>, std::decay_t<Final>>;
+    // shared by the nt tasks, each one only captures a pointer to it
+    auto state = std::make_shared<State>(std::forward<F>(f),
+                                         std::forward<Final>(final), nt);
+    auto has_final = true;
+    if constexpr (std::is_same_v<std::decay_t<Final>, std::nullptr_t>) {
+        has_final = false;
+    } else if constexpr (std::is_constructible_v<bool, std::decay_t<Final> &>) {
+        has_final = (bool)state->final; // an empty std::function
+    }
+    if (!has_final) {
         for (size_t tidx = 0; tidx < nt; tidx++) {
-            this->go([tidx, nt, f] { f(tidx, nt); });
+            this->go([tidx, state] { state->f(tidx, state->nt); }, launch);
         }
         return;
     }
-    auto inner = std::make_shared<WaitGroup>();
-    inner->together([f](size_t tidx, size_t nthds) { f(tidx, nthds); }, nullptr,
-                    nt);
-    this->go([inner, final]() {
-        inner->wait();
-        final();
-    });
+    if constexpr (!std::is_same_v<std::decay_t<Final>, std::nullptr_t>) {
+        // the last one out runs final, nobody blocks waiting for the others
+        add();
+        for (size_t tidx = 0; tidx < nt; tidx++) {
+            this->go(
+                [this, tidx, state] {
+                    state->f(tidx, state->nt);
+                    if (state->left.fetch_sub(1, std::memory_order_acq_rel) ==
+                        1) {
+                        try {
+                            state->final();
+                            done();
+                        } catch (...) {
+                            done();
+                            throw;
+                        }
+                    }
+                },
+                launch);
+        }
+        if (nt == 0) {
+            state->final();
+            done();
+        }
+    }
 }
 
 void WaitGroup::wait() {
     std::unique_lock<std::mutex> ul(mtx_);
+    if (count_ <= 0)
+        return;
+    Executor::Blocking blocking;
     cv_.wait(ul, [this] { return count_ <= 0; });
 }
+
+// the hook takes mtx_ with the context locked, it is registered before
+// mtx_ and goes after it
+bool WaitGroup::wait(const Context &ctx) {
+    {
+        std::unique_lock<std::mutex> _(mtx_);
+        if (count_ <= 0)
+            return true;
+    }
+    internal::CancelHook hook{ctx, [this] {
+                                  std::unique_lock<std::mutex> _(mtx_);
+                                  cv_.notify_all();
+                              }};
+    std::unique_lock<std::mutex> ul(mtx_);
+    Executor::Blocking blocking;
+    cv_.wait(ul, [&] { return count_ <= 0 || ctx.cancelled(); });
+    return count_ <= 0;
+}
 } // namespace goxx
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include "goxx/goxx.hpp"
 #include <algorithm>
 #include <any>
+#include <array>
 #include <chrono>
+#include <climits>
 #include <cstdio>
 #include <deque>
 #include <fmt/core.h>
@@ -9,9 +11,16 @@
 #include <fmt/ranges.h>
 #include <iostream>
 #include <map>
+#include <memory_resource>
 #include <mutex>
+#include <numeric>
 #include <queue>
+#include <random>
 #include <variant>
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -105,6 +114,870 @@ void test_chan() {
                 }
 }
 
+void test_chan_close() {
+    for (size_t csize : {1, 7, 1024}) {
+        Chan<int> c{csize};
+        auto n = std::min(csize, size_t(100));
+        for (size_t i = 0; i < n; i++) {
+            c.push((int)i);
+        }
+        c.close();
+        if (c.push(-1) || c.try_push(-1)) {
+            fmt::print("csize {} push after close succeeded\n", csize);
+        }
+        size_t popped = 0;
+        for (auto x : c) {
+            if (x != (int)popped) {
+                fmt::print("csize {} popped {} != {}\n", csize, x, popped);
+            }
+            popped++;
+        }
+        if (popped != n || !c.exhausted()) {
+            fmt::print("csize {} drained {} of {}\n", csize, popped, n);
+        }
+    }
+    fmt::print("test_chan_close done\n");
+}
+
+void test_spsc_chan() {
+    for (size_t csize : {1024, 64, 1}) {
+        auto count = 10000000;
+        SpscChan<int> c{csize};
+        long long sum = 0;
+        auto d = elapse([&]() {
+            WaitGroup wg{};
+            wg.go([&c, &count]() {
+                for (auto i = 0; i < count; i++) {
+                    c.push(std::move(i));
+                }
+                c.close();
+            });
+            wg.go([&c, &sum]() {
+                for (auto n : c) {
+                    sum += n;
+                }
+            });
+            wg.wait();
+        });
+        if (sum != (long long)count * (count - 1) / 2) {
+            fmt::print("spsc chan size {} lost messages\n", csize);
+        }
+        fmt::print("spsc chan size {}, count {}, elapse {} ms, {} msg/s\n",
+                   csize, count, d / 1ms,
+                   (long long)(count / (d / 1.0s)));
+    }
+}
+
+void test_chan_batch() {
+    auto count = 1000000;
+    for (size_t batch : {1, 16, 256}) {
+        Chan<int> c{1024};
+        long long sum = 0;
+        auto d = elapse([&]() {
+            WaitGroup wg{};
+            wg.go([&c, &count, &batch]() {
+                vector<int> buf(batch);
+                for (auto i = 0; i < count;) {
+                    auto n = std::min((int)batch, count - i);
+                    for (auto j = 0; j < n; j++) {
+                        buf[j] = i + j;
+                    }
+                    for (auto first = buf.begin(), last = first + n;
+                         first != last;) {
+                        first += c.push_range(first, last);
+                    }
+                    i += n;
+                }
+                c.close();
+            });
+            wg.go([&c, &sum, &batch]() {
+                for (auto &b : c.batches(batch)) {
+                    for (auto n : b) {
+                        sum += n;
+                    }
+                }
+            });
+            wg.wait();
+        });
+        if (sum != (long long)count * (count - 1) / 2) {
+            fmt::print("batch {} lost messages\n", batch);
+        }
+        fmt::print("chan batch {}, count {}, elapse {} ms\n", batch, count,
+                   d / 1ms);
+    }
+}
+
+void test_select() {
+    for (size_t csize : {0, 1, 64}) {
+        Chan<int> ints{csize};
+        Chan<string> strs{csize};
+        WaitGroup wg{};
+        auto count = 1000;
+        wg.go([&]() {
+            for (auto i = 0; i < count; i++) {
+                ints.push(std::move(i));
+            }
+            ints.close();
+        });
+        wg.go([&]() {
+            for (auto i = 0; i < count; i++) {
+                strs.push(to_string(i));
+            }
+            strs.close();
+        });
+        long long isum = 0, ssum = 0;
+        auto closed = 0, timeouts = 0;
+        // a case whose handler does not take Closed drops out once drained
+        while (select(recv(ints, [&](int v) { isum += v; }),
+                      recv(strs, cases{
+                                     [&](string s) { ssum += stoi(s); },
+                                     [&](Closed) { closed++; },
+                                 }),
+                      timeout(1s, [&]() { timeouts++; })) != 1 ||
+               !closed) {
+        }
+        // ints may still hold values when strs got closed
+        while (select(recv(ints, [&](int v) { isum += v; })) !=
+               select_none) {
+        }
+        wg.wait();
+        auto expect = (long long)count * (count - 1) / 2;
+        if (isum != expect || ssum != expect) {
+            fmt::print("select csize {} sums {} {} != {}\n", csize, isum, ssum,
+                       expect);
+        }
+
+        Chan<int> acks{csize};
+        wg.go([&]() {
+            for (auto x : acks) {
+                isum += x;
+            }
+        });
+        auto sent = 0;
+        while (sent < count) {
+            select(send(acks, 1, [&]() { sent++; }));
+        }
+        acks.close();
+        wg.wait();
+
+        // nothing ready, default case runs
+        Chan<int> idle{csize};
+        auto hit = select(recv(idle, [](int) {}), otherwise([]() {}));
+        fmt::print("select csize {} done, timeouts {}, default {}\n", csize,
+                   timeouts, hit == 1);
+    }
+}
+
+void test_chan_unbuffered() {
+    // close wakes a parked receiver
+    {
+        Chan<int> c{0};
+        WaitGroup wg{};
+        optional<int> got{-1};
+        wg.go([&]() { got = c.pop(); });
+        this_thread::sleep_for(10ms);
+        c.close();
+        wg.wait();
+        if (got) {
+            fmt::print("receiver not released by close\n");
+        }
+    }
+    // select on both ends of the same unbuffered chan
+    {
+        Chan<int> c{0};
+        WaitGroup wg{};
+        auto count = 10000;
+        long long sum = 0;
+        wg.go([&]() {
+            for (auto i = 0; i < count; i++) {
+                select(send(c, std::move(i), []() {}));
+            }
+            c.close();
+        });
+        for (auto done = false; !done;) {
+            select(recv(c, cases{
+                               [&](int v) { sum += v; },
+                               [&](Closed) { done = true; },
+                           }));
+        }
+        wg.wait();
+        if (sum != (long long)count * (count - 1) / 2) {
+            fmt::print("select rendezvous lost values\n");
+        }
+    }
+    fmt::print("test_chan_unbuffered done\n");
+}
+
+// needs GOXX_CHAN_STATS, e.g. cmake -DGOXX_CHAN_STATS=ON
+void test_chan_stats() {
+#ifdef GOXX_CHAN_STATS
+    for (size_t csize : {0, 16}) {
+        Chan<int> c{csize};
+        c.set_name(fmt::format("stats{}", csize));
+        auto count = 10000;
+        WaitGroup wg{};
+        wg.go([&]() {
+            for (auto i = 0; i < count; i++) {
+                c.push((int)i);
+            }
+            c.close();
+        });
+        for (auto n : c) {
+            (void)n;
+        }
+        wg.wait();
+        (void)c.try_pop();
+        auto s = c.stats();
+        if (s.pushes != (uint64_t)count || s.pops != (uint64_t)count ||
+            s.try_pop_failed != 1 || s.high_water > csize ||
+            s.latency.count() == 0) {
+            fmt::print("stats {}: wrong counters\n", csize);
+        }
+        dump_chan_stats(stdout);
+    }
+    Histogram h;
+    for (uint64_t v = 0; v < 1000; v++) {
+        h.record(v);
+    }
+    auto p50 = h.percentile(50);
+    if (p50 < 499 || p50 > 499 * 9 / 8 || h.max() < 999) {
+        fmt::print("histogram p50 {} max {}\n", p50, h.max());
+    }
+    fmt::print("test_chan_stats done\n");
+#endif
+}
+
+void test_pipeline() {
+    using namespace goxx::pipeline;
+    auto count = 100000;
+    vector<int> input(count);
+    iota(input.begin(), input.end(), 0);
+    // unordered parallel stage, fused filter, sink called one at a time
+    long long sum = 0;
+    size_t n = 0;
+    from(input.begin(), input.end()) |
+        goxx::pipeline::map([](int x) { return (long long)x * 2; }, 4) |
+        filter([](long long x) { return x % 3 == 0; }) |
+        sink([&](long long x) {
+            sum += x;
+            n++;
+        });
+    long long expect = 0;
+    for (auto x : input) {
+        expect += x * 2 % 3 == 0 ? x * 2 : 0;
+    }
+    if (sum != expect || n != (size_t)(count + 2) / 3) {
+        fmt::print("pipeline: sum {} != {}\n", sum, expect);
+    }
+    // ordered, with uneven work per value
+    auto ordered = from(input.begin(), input.end()) |
+                   goxx::pipeline::map(
+                       [](int x) {
+                           for (volatile int i = 0; i < x % 97; i = i + 1) {
+                           }
+                           return to_string(x);
+                       },
+                       4, true, 64) |
+                   goxx::pipeline::map([](string s) { return stoi(s); }) |
+                   collect();
+    if (ordered != input) {
+        fmt::print("pipeline: order lost\n");
+    }
+    // batches, from a generator and from a chan
+    auto i = 0;
+    auto batches = generate([&]() -> optional<int> {
+                       if (i == 1000)
+                           return nullopt;
+                       return i++;
+                   }) |
+                   batch(64) | collect();
+    if (batches.size() != 16 || batches.back().size() != 1000 % 64 ||
+        batches[3][5] != 3 * 64 + 5) {
+        fmt::print("pipeline: wrong batches\n");
+    }
+    Chan<int> c{16};
+    WaitGroup wg{};
+    wg.go([&]() {
+        for (auto j = 0; j < 1000; j++) {
+            c.push((int)j);
+        }
+        c.close();
+    });
+    auto total = 0;
+    from(c) | goxx::pipeline::map([](int x) { return x + 1; }, 3) | batch(10) |
+        sink([&](vector<int> b) {
+            for (auto x : b) {
+                total += x;
+            }
+        });
+    if (total != 1000 * 1001 / 2) {
+        fmt::print("pipeline: chan source lost values\n");
+    }
+    fmt::print("test_pipeline done\n");
+}
+
+void test_broadcast_chan() {
+    // every subscriber sees every value, the producer waits for the slowest
+    BroadcastChan<int> c{8};
+    vector<BroadcastChan<int>::Subscription> subs;
+    for (auto i = 0; i < 4; i++) {
+        subs.push_back(c.subscribe());
+    }
+    vector<long long> sums(subs.size());
+    auto count = 10000;
+    {
+        WaitGroup wg{};
+        for (size_t i = 0; i < subs.size(); i++) {
+            wg.go([&, i]() {
+                for (const int &x : subs[i]) {
+                    sums[i] += x;
+                }
+            });
+        }
+        for (auto i = 0; i < count; i++) {
+            c.push((int)i);
+        }
+        c.close();
+    }
+    for (auto sum : sums) {
+        if (sum != (long long)count * (count - 1) / 2) {
+            fmt::print("broadcast_chan: sum {}\n", sum);
+        }
+    }
+    // one copy of a value, read in place by all
+    BroadcastChan<string> s{4};
+    auto a = s.subscribe();
+    auto b = s.subscribe();
+    s.push("shared");
+    const string *pa = nullptr, *pb = nullptr;
+    a.next([&](const string &x) { pa = &x; });
+    b.next([&](const string &x) { pb = &x; });
+    if (!pa || pa != pb || *pa != "shared") {
+        fmt::print("broadcast_chan: value copied\n");
+    }
+    // block: a full ring fails try_push until the lagging one leaves
+    BroadcastChan<int> bl{4};
+    auto lag = make_optional(bl.subscribe());
+    for (auto i = 0; i < 4; i++) {
+        bl.push((int)i);
+    }
+    if (bl.try_push(4)) {
+        fmt::print("broadcast_chan: try_push past a lagging subscriber\n");
+    }
+    lag.reset();
+    if (!bl.try_push(4)) {
+        fmt::print("broadcast_chan: still blocked after unsubscribe\n");
+    }
+    // drop_oldest: the lagging one skips to the oldest value left
+    BroadcastChan<int> d{4, Overflow::drop_oldest};
+    auto slow = d.subscribe();
+    for (auto i = 0; i < 100; i++) {
+        d.push((int)i);
+    }
+    d.close();
+    vector<int> got;
+    while (auto x = slow.pop()) {
+        got.push_back(*x);
+    }
+    if (got != vector<int>{96, 97, 98, 99} || slow.dropped() != 96) {
+        fmt::print("broadcast_chan: drop_oldest got {} dropped {}\n", got,
+                   slow.dropped());
+    }
+    // disconnect: the lagging one is cut off, the others go on
+    BroadcastChan<int> x{4, Overflow::disconnect};
+    auto cut = x.subscribe();
+    auto fast = x.subscribe();
+    auto n = 0;
+    for (auto i = 0; i < 10; i++) {
+        x.push((int)i);
+        n += fast.pop().has_value();
+    }
+    if (!cut.disconnected() || cut.pop() || n != 10) {
+        fmt::print("broadcast_chan: lagging subscriber not disconnected\n");
+    }
+    fmt::print("test_broadcast_chan done\n");
+}
+
+#ifdef __linux__
+void test_shm_chan() {
+    struct Tick {
+        long seq;
+        double px;
+    };
+    auto name = fmt::format("/goxx_test_{}", getpid());
+    ShmChan<Tick>::unlink(name);
+    // a child process pushes, the parent pops
+    {
+        ShmChan<Tick> c{name, 64};
+        auto count = 100000L;
+        auto pid = fork();
+        if (pid == 0) {
+            ShmChan<Tick> p{name, 0};
+            for (auto i = 0L; i < count; i++) {
+                p.push({i, i * 0.5});
+            }
+            p.close();
+            _exit(0);
+        }
+        auto next = 0L;
+        for (auto t : c) {
+            if (t.seq != next++ || t.px != t.seq * 0.5) {
+                fmt::print("shm_chan: got {} for {}\n", t.seq, next - 1);
+                break;
+            }
+        }
+        waitpid(pid, nullptr, 0);
+        if (next != count || c.broken()) {
+            fmt::print("shm_chan: popped {} of {}\n", next, count);
+        }
+    }
+    ShmChan<Tick>::unlink(name);
+    // a producer dying without close ends the stream for the others
+    {
+        ShmChan<Tick> c{name, 64};
+        auto pid = fork();
+        if (pid == 0) {
+            ShmChan<Tick> p{name, 0};
+            for (auto i = 0L; i < 10; i++) {
+                p.push({i, 0});
+            }
+            _exit(1);
+        }
+        auto n = 0;
+        for (auto t : c) {
+            (void)t;
+            n++;
+        }
+        waitpid(pid, nullptr, 0);
+        if (n != 10 || !c.broken()) {
+            fmt::print("shm_chan: crash not detected, popped {}\n", n);
+        }
+    }
+    ShmChan<Tick>::unlink(name);
+    // a mapped file, and a layout that does not fit
+    auto path = fmt::format("/tmp/goxx_test_{}", getpid());
+    {
+        ShmChan<Tick> a{path, 4};
+        ShmChan<Tick> b{path, 0};
+        a.push({1, 2});
+        if (b.try_pop()->seq != 1 || b.try_pop()) {
+            fmt::print("shm_chan: file backed chan lost a value\n");
+        }
+        try {
+            ShmChan<int> wrong{path, 0};
+            fmt::print("shm_chan: attached with the wrong type\n");
+        } catch (const std::runtime_error &) {
+        }
+    }
+    ShmChan<Tick>::unlink(path);
+    fmt::print("test_shm_chan done\n");
+}
+#endif
+
+void test_timer() {
+    using namespace std::chrono;
+    // fires on time, within the tolerance
+    auto tolerance = microseconds(GOXX_TIMER_TICK_US) + milliseconds(20);
+    for (auto d : {milliseconds(1), milliseconds(30), milliseconds(150)}) {
+        auto start = TimerClock::now();
+        auto c = goxx::after(d);
+        auto at = c->pop();
+        auto late = *at - (start + d);
+        if (late < nanoseconds(0) || late > tolerance) {
+            fmt::print("timer: {}ms after fired {}us late\n", d.count(),
+                       duration_cast<microseconds>(late).count());
+        }
+    }
+    // stop, reset
+    Timer t{milliseconds(10)};
+    if (!t.stop() || t.stop() || t.chan().try_pop()) {
+        fmt::print("timer: stop\n");
+    }
+    if (t.reset(milliseconds(5)) || !t.chan().pop() || t.stop()) {
+        fmt::print("timer: reset\n");
+    }
+    // a ticker ticks until stopped, reset changes its period
+    Ticker tk{milliseconds(5)};
+    auto start = TimerClock::now();
+    for (auto i = 0; i < 5; i++) {
+        tk.chan().pop();
+    }
+    auto took = TimerClock::now() - start;
+    if (took < milliseconds(20) || took > milliseconds(25) + 5 * tolerance) {
+        fmt::print("ticker: 5 ticks of 5ms took {}ms\n",
+                   duration_cast<milliseconds>(took).count());
+    }
+    tk.stop();
+    tk.chan().try_pop();
+    this_thread::sleep_for(milliseconds(15));
+    if (tk.chan().try_pop()) {
+        fmt::print("ticker: ticked after stop\n");
+    }
+    tk.reset(milliseconds(2));
+    tk.chan().pop();
+    tk.stop();
+    // many timers, half of them stopped
+    auto count = 100000;
+    atomic<int> fired{0};
+    vector<Timer> timers;
+    timers.reserve(count);
+    mt19937 rng{42};
+    for (auto i = 0; i < count; i++) {
+        timers.emplace_back(milliseconds(1 + rng() % 200), [&]() { fired++; });
+    }
+    auto stopped = 0;
+    for (auto i = 0; i < count; i += 2) {
+        stopped += timers[i].stop();
+    }
+    for (auto deadline = TimerClock::now() + seconds(5);
+         fired + stopped != count && TimerClock::now() < deadline;) {
+        this_thread::sleep_for(milliseconds(10));
+    }
+    if (fired + stopped != count) {
+        fmt::print("timer: {} fired, {} stopped of {}\n", fired.load(),
+                   stopped, count);
+    }
+    if (timers[1].chan().try_pop()) {
+        fmt::print("timer: f timer pushed into its chan\n");
+    }
+    fmt::print("test_timer done\n");
+}
+
+void test_context() {
+    using namespace std::chrono;
+    // the background is never cancelled, a cancel goes down, not up
+    Context bg;
+    auto parent = bg.with_cancel();
+    auto child = parent.with_cancel();
+    auto grandchild = child.with_timeout(hours(1));
+    if (bg.cancelled() || bg.err() != ContextError::none ||
+        bg.deadline() != Context::Clock::time_point::max() ||
+        bg.done().try_pop() || bg.done().closed()) {
+        fmt::print("context: background\n");
+    }
+    child.cancel();
+    if (parent.cancelled() || !child.cancelled() ||
+        grandchild.err() != ContextError::cancelled ||
+        !grandchild.done().closed() ||
+        parent.with_cancel().cancelled() || !child.with_cancel().cancelled()) {
+        fmt::print("context: propagation\n");
+    }
+    // a deadline cancels, a child never outlives the parent's
+    auto start = TimerClock::now();
+    auto ctx = bg.with_timeout(milliseconds(20));
+    if (ctx.with_timeout(hours(1)).deadline() != ctx.deadline()) {
+        fmt::print("context: inherited deadline\n");
+    }
+    Chan<int> c{2};
+    auto popped = c.pop(ctx);
+    auto took = TimerClock::now() - start;
+    if (popped || ctx.err() != ContextError::deadline_exceeded ||
+        took < milliseconds(20) || took > seconds(1)) {
+        fmt::print("context: pop with deadline took {}ms\n",
+                   duration_cast<milliseconds>(took).count());
+    }
+    if (bg.with_deadline(TimerClock::now()).err() !=
+        ContextError::deadline_exceeded) {
+        fmt::print("context: past deadline\n");
+    }
+    // blocked push / pop, buffered and not, return once cancelled.
+    // the value stays with the caller
+    for (size_t csize : {1, 0}) {
+        Chan<unique_ptr<int>> ch{csize};
+        if (csize)
+            ch.push(make_unique<int>(0));
+        for (auto push : {true, false}) {
+            if (!push && csize)
+                ch.pop();
+            auto ctx = bg.with_cancel();
+            std::thread canceller([ctx]() {
+                this_thread::sleep_for(milliseconds(10));
+                ctx.cancel();
+            });
+            auto p = make_unique<int>(1);
+            auto ok = push ? ch.push(std::move(p), ctx) : !!ch.pop(ctx);
+            canceller.join();
+            if (ok || (push && !p)) {
+                fmt::print("context: {} {} not cancelled\n",
+                           csize ? "buffered" : "unbuffered",
+                           push ? "push" : "pop");
+            }
+        }
+        // a cancelled context still takes what is ready
+        auto cancelled = bg.with_cancel();
+        cancelled.cancel();
+        std::thread other([&]() { ch.push(make_unique<int>(2)); });
+        if (!csize)
+            this_thread::sleep_for(milliseconds(10));
+        auto v = ch.pop(cancelled);
+        if (!v)
+            v = ch.pop();
+        other.join();
+        if (!v || **v != 2)
+            fmt::print("context: value lost\n");
+    }
+    // WaitGroup: wait gives up, go skips what has not started
+    {
+        WaitGroup wg{};
+        auto ctx = bg.with_timeout(milliseconds(20));
+        atomic<int> ran{0};
+        wg.go([&]() {
+            while (!ctx.cancelled()) {
+                this_thread::sleep_for(milliseconds(1));
+            }
+        });
+        if (wg.wait(ctx) || !ctx.cancelled())
+            fmt::print("context: wait group wait\n");
+        wg.go([&]() { ran++; }, ctx);
+        wg.wait();
+        if (ran != 0)
+            fmt::print("context: wait group go\n");
+        if (!wg.wait(bg.with_cancel()))
+            fmt::print("context: wait group wait done\n");
+    }
+    // mt_sort: cancelled or sorted, the elements are always kept
+    mt19937 rng{7};
+    for (auto radix : {true, false}) {
+        for (auto delay : {-1, 0, 1, 5, 1000}) {
+            vector<uint64_t> v(2000000);
+            for (auto &x : v)
+                x = rng();
+            auto expect = v;
+            std::sort(expect.begin(), expect.end());
+            auto ctx = bg.with_cancel();
+            if (delay < 0)
+                ctx.cancel();
+            Timer t{milliseconds(max(delay, 0)), [ctx]() { ctx.cancel(); }};
+            auto sorted =
+                radix ? mt_sort(v.begin(), v.end(), std::less<>{}, ctx)
+                      : mt_sort(
+                            v.begin(), v.end(),
+                            [](uint64_t a, uint64_t b) { return a < b; }, ctx);
+            if (sorted != std::is_sorted(v.begin(), v.end()) ||
+                (delay < 0 && sorted)) {
+                fmt::print("context: mt_sort returned {}\n", sorted);
+            }
+            std::sort(v.begin(), v.end());
+            if (v != expect)
+                fmt::print("context: mt_sort lost elements\n");
+        }
+    }
+    fmt::print("test_context done\n");
+}
+
+// counts what reaches the upstream of a PoolResource
+struct CountingResource : std::pmr::memory_resource {
+    atomic<size_t> allocs{0};
+    atomic<size_t> live{0};
+    void *do_allocate(size_t bytes, size_t align) override {
+        allocs++;
+        live++;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+        live--;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+};
+
+struct PooledMsg {
+    static inline atomic<size_t> made{0};
+    PooledMsg() { made++; }
+    vector<int> v;
+    string s;
+    void clear() {
+        v.clear();
+        s.clear();
+    }
+};
+
+void test_msg_pool() {
+    // a value comes back cleared, with its capacity
+    {
+        MsgPool<vector<int>> pool{4};
+        auto m = pool.get();
+        m->assign(1000, 7);
+        auto *data = m->data();
+        m.reset();
+        auto again = pool.get();
+        if (!again->empty() || again->capacity() < 1000 ||
+            again->data() != data) {
+            fmt::print("msg_pool: not recycled\n");
+        }
+    }
+    // producer to consumer, the pool stops growing once it holds what is
+    // in flight
+    {
+        size_t count = 200000;
+        MsgPool<PooledMsg> pool{16};
+        Chan<MsgPool<PooledMsg>::Ptr> c{64};
+        WaitGroup wg{};
+        wg.go(
+            [&]() {
+                for (size_t i = 0; i < count; i++) {
+                    auto m = pool.get();
+                    m->v.assign(i % 100, (int)i);
+                    m->s = to_string(i);
+                    c.push(std::move(m));
+                }
+                c.close();
+            },
+            Launch::dedicated);
+        size_t i = 0;
+        for (auto m : c) {
+            if (m->v.size() != i % 100 || m->s != to_string(i) ||
+                (!m->v.empty() && m->v[0] != (int)i)) {
+                fmt::print("msg_pool: wrong message {}\n", i);
+                break;
+            }
+            i++;
+        }
+        wg.wait();
+        if (i != count || PooledMsg::made > 64 + 2 * 16 * 3) {
+            fmt::print("msg_pool: {} of {}, {} made\n", i, count,
+                       PooledMsg::made.load());
+        }
+    }
+    // pmr: the payload blocks cross threads and come back to the pool
+    {
+        CountingResource upstream;
+        {
+            PoolResource res{&upstream, 16};
+            using Map = std::pmr::map<std::pmr::string, std::pmr::string>;
+            Chan<Map> c{64};
+            auto round = [&](size_t count) {
+                WaitGroup wg{};
+                wg.go(
+                    [&]() {
+                        for (size_t i = 0; i < count; i++) {
+                            Map m{&res};
+                            for (auto k = 0; k < 8; k++) {
+                                m.emplace(fmt::format("key {:>20}", k),
+                                          std::pmr::string(i % 200, 'x'));
+                            }
+                            c.push(std::move(m));
+                        }
+                    },
+                    Launch::dedicated);
+                for (size_t i = 0; i < count; i++) {
+                    auto m = c.pop();
+                    if (!m || m->size() != 8 ||
+                        m->begin()->second.size() != i % 200) {
+                        fmt::print("msg_pool: wrong map {}\n", i);
+                        break;
+                    }
+                }
+            };
+            round(20000);
+            auto warm = upstream.allocs.load();
+            round(20000);
+            if (upstream.allocs - warm > warm / 2) {
+                fmt::print("msg_pool: {} upstream allocations warm, {} "
+                           "more after\n",
+                           warm, upstream.allocs - warm);
+            }
+            // too big or over aligned, straight to upstream
+            auto before = upstream.allocs.load();
+            auto *p = res.allocate(1 << 20);
+            auto *q = res.allocate(64, 256);
+            res.deallocate(p, 1 << 20);
+            res.deallocate(q, 64, 256);
+            if (upstream.allocs - before != 2 || (uintptr_t)q % 256) {
+                fmt::print("msg_pool: big / aligned blocks\n");
+            }
+        }
+        if (upstream.live != 0) {
+            fmt::print("msg_pool: {} blocks not back upstream\n",
+                       upstream.live.load());
+        }
+    }
+    fmt::print("test_msg_pool done\n");
+}
+
+// byte i of the stream
+static char byte_at(size_t i) {
+    return (char)(i * 131 + (i >> 9));
+}
+
+void test_byte_chan() {
+    for (auto double_map : {true, false}) {
+        ByteChan c{1, double_map};
+        if (c.capacity() < 4096 || (c.capacity() & (c.capacity() - 1))) {
+            fmt::print("byte_chan: capacity {}\n", c.capacity());
+        }
+        // random chunks on both sides, many laps around the ring, every
+        // view contiguous across the end
+        size_t total = 50 * c.capacity() + 123;
+        WaitGroup wg{};
+        wg.go(
+            [&]() {
+                std::mt19937 rng{1};
+                for (size_t pos = 0; pos < total;) {
+                    auto n = std::min<size_t>(
+                        total - pos, 1 + rng() % (c.capacity() / 2));
+                    auto buf = c.prepare(n);
+                    for (size_t i = 0; i < n; i++) {
+                        buf[i] = byte_at(pos + i);
+                    }
+                    // not always all of it
+                    auto k = rng() % 4 ? n : n / 2;
+                    c.commit(k);
+                    pos += k;
+                }
+                c.close();
+            },
+            Launch::dedicated);
+        std::mt19937 rng{2};
+        size_t pos = 0, across = 0;
+        auto ok = true;
+        for (;;) {
+            auto min = 1 + rng() % 100;
+            auto v = c.read_view(min);
+            if (v.empty())
+                break;
+            if (v.size() < min && !c.closed()) {
+                fmt::print("byte_chan: {} bytes, asked {}\n", v.size(), min);
+            }
+            if ((pos & (c.capacity() - 1)) + v.size() > c.capacity())
+                across++;
+            for (size_t i = 0; i < v.size() && ok; i++) {
+                ok = v[i] == byte_at(pos + i);
+            }
+            if (!ok) {
+                fmt::print("byte_chan: wrong byte near {}\n", pos);
+                break;
+            }
+            auto k = std::min<size_t>(v.size(), 1 + rng() % 8192);
+            c.consume(k);
+            pos += k;
+        }
+        wg.wait();
+        if (ok && (pos != total || across == 0 || !c.exhausted())) {
+            fmt::print("byte_chan: {} of {}, {} views across the end\n", pos,
+                       total, across);
+        }
+        // closed: no more room, the rest still readable
+        ByteChan d{4096, double_map};
+        d.write("hello", 5);
+        d.close();
+        char out[8];
+        if (!d.prepare(1).empty() || d.write("x", 1) != 0 ||
+            d.read(out, 8) != 5 || d.read(out, 8) != 0 ||
+            !d.read_view().empty()) {
+            fmt::print("byte_chan: close\n");
+        }
+        try {
+            d.prepare(d.capacity() + 1);
+            fmt::print("byte_chan: prepare past the capacity\n");
+        } catch (std::length_error &) {
+        }
+    }
+    fmt::print("test_byte_chan done\n");
+}
+
 void test_wg() {
     WaitGroup wg{};
     int x = 0;
@@ -122,6 +995,42 @@ void test_wg() {
         }
     });
 }
+void test_task() {
+    // move only captures, through go and a Task moved around
+    WaitGroup wg{};
+    auto sum = std::make_shared<std::atomic<int>>(0);
+    for (auto i = 0; i < 100; i++) {
+        wg.go([p = std::make_unique<int>(i), sum]() { *sum += *p; });
+    }
+    Task t{[p = std::make_unique<int>(1000), sum]() { *sum += *p; }};
+    auto moved = std::move(t);
+    if (t || !moved) {
+        fmt::print("task: moved from state wrong\n");
+    }
+    wg.go(std::move(moved));
+    // together, f and final move only
+    wg.together(
+        [p = std::make_unique<int>(10), sum](size_t, size_t) { *sum += *p; },
+        [p = std::make_unique<int>(100), sum]() { *sum += *p; }, 4);
+    // too big for the inline buffer, goes to the heap
+    std::array<char, 2 * Task::inline_size> big{};
+    wg.go([big, sum]() { *sum += big[0] + 1; });
+    wg.wait();
+    if (*sum != 99 * 100 / 2 + 1000 + 4 * 10 + 100 + 1) {
+        fmt::print("task: sum {}\n", sum->load());
+    }
+    auto deferred = false;
+    {
+        goxx_defer([&deferred, p = std::make_unique<int>(1)]() {
+            deferred = *p == 1;
+        });
+    }
+    if (!deferred) {
+        fmt::print("task: defer did not run\n");
+    }
+    fmt::print("test_task done\n");
+}
+
 void test_mt_sort_origin() {
     size_t N = 100000000;
     vector<size_t> vec(N);
@@ -144,28 +1053,176 @@ void test_mt_sort_origin() {
     }
 }
 
-void test_mt_sort() {
-    size_t N = 10000;
-    vector<size_t> vec(N);
-    for (size_t i = 0; i < N; i++) {
-        vec[i] = (size_t)rand() / N;
+// mt_sort against std::sort, sorted / reversed / random / few unique input
+void test_mt_sort(size_t max_n = 1000000000) {
+    auto inputs = {"sorted", "reversed", "random", "few unique"};
+    for (size_t N = 10000; N <= max_n; N *= 10) {
+        for (string input : inputs) {
+            vector<size_t> vec(N);
+            mt19937_64 rng{N};
+            for (size_t i = 0; i < N; i++) {
+                if (input == "sorted") {
+                    vec[i] = i;
+                } else if (input == "reversed") {
+                    vec[i] = N - i;
+                } else if (input == "random") {
+                    vec[i] = rng();
+                } else {
+                    vec[i] = rng() % 16;
+                }
+            }
+            auto ref = vec;
+            auto cmp = vec;
+            auto d_std = elapse([&]() { sort(begin(ref), end(ref)); });
+            // a lambda comparator keeps mt_sort off the radix path
+            auto d_cmp = elapse([&]() {
+                mt_sort(begin(cmp), end(cmp),
+                        [](size_t a, size_t b) { return a < b; });
+            });
+            auto d = elapse([&]() { mt_sort(begin(vec), end(vec)); });
+            if (vec != ref || cmp != ref) {
+                fmt::print("N {} {}: test failed, not sorted\n", N, input);
+            }
+            fmt::print("N {}, {}: mt_sort {} us, comparison mt_sort {} us, "
+                       "std::sort {} us\n",
+                       N, input, d / 1us, d_cmp / 1us, d_std / 1us);
+        }
     }
-    // vec = {1118, 314, 1634, 10, 998, 2102, 2345, 2332, 3186, 3225};
-    cout << "start\n";
-    auto d = elapse([&]() { mt_sort(begin(vec), end(vec)); });
-    cout << " elapse " << (d / chrono::milliseconds(1)) << "ms\n";
-    if (!is_sorted(vec.begin(), vec.end())) {
-        cout << " test failed, not sorted\n";
-        for (auto v : vec) {
-            cout << v << " ";
+    // descending, through the comparator overload
+    vector<int> vec(100000);
+    iota(vec.begin(), vec.end(), -50000);
+    mt_sort(vec.begin(), vec.end(), greater<>{});
+    if (!is_sorted(vec.begin(), vec.end(), greater<>{})) {
+        fmt::print("greater: test failed, not sorted\n");
+    }
+    // doubles of both signs
+    mt19937_64 rng{1};
+    normal_distribution<double> dist{0, 1e6};
+    vector<double> dbl(1000000);
+    for (auto &d : dbl) {
+        d = dist(rng);
+    }
+    auto d = elapse([&]() { mt_sort(dbl.begin(), dbl.end()); });
+    if (!is_sorted(dbl.begin(), dbl.end())) {
+        fmt::print("double: test failed, not sorted\n");
+    }
+    fmt::print("N {}, double: mt_sort {} us\n", dbl.size(), d / 1us);
+    // structs by key, stable
+    struct Item {
+        int64_t key;
+        string name;
+    };
+    vector<Item> items;
+    for (auto i = 0; i < 100000; i++) {
+        items.push_back({(int64_t)(rng() % 1000) - 500, to_string(i)});
+    }
+    mt_sort_by_key(items.begin(), items.end(),
+                   [](const Item &it) { return it.key; });
+    auto stable = is_sorted(items.begin(), items.end(),
+                            [](const Item &a, const Item &b) {
+                                return a.key < b.key ||
+                                       (a.key == b.key &&
+                                        stoi(a.name) < stoi(b.name));
+                            });
+    if (!stable) {
+        fmt::print("by key: test failed, not sorted or not stable\n");
+    }
+    // move only, through the sample sort
+    vector<unique_ptr<int>> ptrs;
+    for (auto i = 0; i < 200000; i++) {
+        ptrs.push_back(make_unique<int>((int)(rng() % 100000)));
+    }
+    auto by_value = [](auto &a, auto &b) { return *a < *b; };
+    mt_sort(ptrs.begin(), ptrs.end(), by_value);
+    if (!is_sorted(ptrs.begin(), ptrs.end(), by_value)) {
+        fmt::print("move only: test failed, not sorted\n");
+    }
+    // a throwing comparator comes out on the caller, nothing leaks
+    atomic<int> calls{0};
+    try {
+        mt_sort(ptrs.begin(), ptrs.end(), [&](auto &a, auto &b) {
+            if (++calls == 1000000)
+                throw runtime_error("comp");
+            return *a > *b;
+        });
+        fmt::print("throwing comp: no exception\n");
+    } catch (runtime_error &) {
+    }
+    // a throwing key on the radix path, in the first pass and a later one
+    for (auto at : {items.size() * 3 / 2, items.size() * 4}) {
+        atomic<size_t> keys{0};
+        try {
+            mt_sort_by_key(items.begin(), items.end(), [&](const Item &it) {
+                if (++keys == at)
+                    throw runtime_error("key");
+                return -it.key;
+            });
+            fmt::print("throwing key: no exception\n");
+        } catch (runtime_error &) {
         }
-        cout << "\n";
-    } else {
-        // cout << " elapse " << (d / chrono::milliseconds(1)) <<
-        // "ms\n";
     }
 }
 
+void test_parallel() {
+    for (size_t N : {0, 1, 7, 1000, 100003, 3000000})
+        for (size_t grain : {0, 1, 97}) {
+            if (grain == 1 && N > 100003)
+                continue;
+            vector<long long> vec(N);
+            iota(vec.begin(), vec.end(), -(long long)N / 2);
+            auto fails = 0;
+            auto doubled = vec;
+            parallel_for(
+                doubled.begin(), doubled.end(), [](long long &v) { v *= 2; },
+                grain);
+            vector<long long> squared(N);
+            parallel_transform(
+                vec.begin(), vec.end(), squared.begin(),
+                [](long long v) { return v * v; }, grain);
+            for (size_t i = 0; i < N; i++) {
+                fails += doubled[i] != vec[i] * 2;
+                fails += squared[i] != vec[i] * vec[i];
+            }
+            auto sum = parallel_reduce(vec.begin(), vec.end(), 10LL,
+                                       std::plus<>{}, grain);
+            fails += sum != accumulate(vec.begin(), vec.end(), 10LL);
+            auto high = parallel_reduce(
+                vec.begin(), vec.end(), LLONG_MIN,
+                [](long long a, long long b) { return std::max(a, b); },
+                grain);
+            fails += N > 0 && high != vec.back();
+            vector<long long> scan(N), expect(N);
+            inclusive_scan(vec.begin(), vec.end(), expect.begin());
+            parallel_inclusive_scan(vec.begin(), vec.end(), scan.begin(),
+                                    std::plus<>{}, grain);
+            fails += scan != expect;
+            // in place
+            parallel_inclusive_scan(vec.begin(), vec.end(), vec.begin(),
+                                    std::plus<>{}, grain);
+            fails += vec != expect;
+            if (fails) {
+                fmt::print("parallel N {} grain {}: {} failures\n", N, grain,
+                           fails);
+            }
+        }
+    // skewed work, the chunks at the front cost far more
+    vector<int> cost(10000);
+    iota(cost.begin(), cost.end(), 0);
+    atomic<size_t> spins{0};
+    auto d = elapse([&]() {
+        parallel_for(
+            cost.begin(), cost.end(),
+            [&](int c) {
+                size_t n = c < 1000 ? 20000 : 10;
+                for (volatile size_t i = 0; i < n; i = i + 1) {
+                }
+                spins += n;
+            },
+            16);
+    });
+    fmt::print("test_parallel done, skewed loop {} ms\n", d / 1ms);
+}
+
 void test_priority_queue() {
     priority_queue<int> q;
     for (int i = 0; i < 10; i++)
@@ -334,8 +1391,23 @@ void test_optional() {
 int main() {
     // test_optional();
     // test_chan();
+    // test_chan_close();
+    // test_spsc_chan();
+    // test_chan_batch();
+    // test_select();
+    // test_chan_unbuffered();
+    // test_chan_stats();
+    // test_pipeline();
+    // test_broadcast_chan();
+    // test_shm_chan();
+    // test_timer();
+    // test_context();
+    // test_msg_pool();
+    // test_byte_chan();
+    // test_task();
     //    test_mt_sort_origin();
     //    test_mt_sort();
+    //    test_parallel();
     //    test_priority_queue();
     //    test_get();
     //   test_any();
@@ -0,0 +1,109 @@
+#include "goxx/goxx.hpp"
+#include <atomic>
+#include <fmt/core.h>
+#include <memory>
+#include <sys/resource.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace goxx;
+
+#if defined(__cpp_impl_coroutine)
+
+Go stage(Chan<long> &in, Chan<long> &out, WaitGroup &wg) {
+    while (auto v = co_await async_pop(in)) {
+        co_await async_push(out, *v + 1);
+    }
+    out.close();
+    wg.done();
+}
+
+Go source(Chan<long> &out, long count, WaitGroup &wg) {
+    for (long i = 0; i < count; i++) {
+        co_await async_push(out, i);
+    }
+    out.close();
+    wg.done();
+}
+
+// a chain of goroutines, each adds one and passes the value on
+void test_co_pipeline() {
+    for (size_t csize : {0, 1, 16}) {
+        size_t nstage = 1000;
+        long count = 1000;
+        vector<unique_ptr<Chan<long>>> chans;
+        for (size_t i = 0; i <= nstage; i++) {
+            chans.push_back(make_unique<Chan<long>>(csize));
+        }
+        long sum = 0;
+        auto d = elapse([&]() {
+            WaitGroup wg{};
+            wg.add(nstage + 1);
+            source(*chans[0], count, wg);
+            for (size_t i = 0; i < nstage; i++) {
+                stage(*chans[i], *chans[i + 1], wg);
+            }
+            // the blocking api on the other end
+            for (auto v : *chans[nstage]) {
+                sum += v;
+            }
+            // chans outlive the goroutines still closing them
+            wg.wait();
+        });
+        if (sum != count * (count - 1) / 2 + count * (long)nstage) {
+            fmt::print("pipeline chan size {}: sum {}\n", csize, sum);
+        }
+        fmt::print("pipeline chan size {}, {} stages x {} values, elapse {} "
+                   "ms\n",
+                   csize, nstage, count, d / 1ms);
+    }
+}
+
+Go sleeper(WaitGroup &gate, WaitGroup &wg, atomic<long> &parked,
+           atomic<long> &woken) {
+    parked++;
+    co_await async_wait(gate);
+    woken++;
+    wg.done();
+}
+
+// memory of parked goroutines, all waiting on one wait group
+void test_co_many() {
+    size_t n = 100000;
+    WaitGroup gate{}, wg{};
+    gate.add();
+    wg.add(n);
+    atomic<long> parked{0}, woken{0};
+    rusage before{}, after{};
+    getrusage(RUSAGE_SELF, &before);
+    for (size_t i = 0; i < n; i++) {
+        sleeper(gate, wg, parked, woken);
+    }
+    while ((size_t)parked < n) {
+        this_thread::sleep_for(10ms);
+    }
+    getrusage(RUSAGE_SELF, &after);
+    gate.done();
+    wg.wait();
+    if ((size_t)woken != n) {
+        fmt::print("goroutines woken {}\n", woken.load());
+    }
+    fmt::print("{} parked goroutines, ~{} bytes each\n", n,
+               (after.ru_maxrss - before.ru_maxrss) * 1024 / (long)n);
+}
+
+int main() {
+    test_co_pipeline();
+    test_co_many();
+    return 0;
+}
+
+#else
+
+int main() {
+    fmt::print("no coroutine support, nothing to test\n");
+    return 0;
+}
+
+#endif